@@ -24,155 +24,850 @@
 #include <string.h>
 #include <locale.h>
 #include <limits.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 /*───────────────────────────────────────────────────────────────────────────│─╗
 │ The LISP Challenge § LISP Machine                                        ─╬─│┼
 ╚────────────────────────────────────────────────────────────────────────────│*/
 
-#define kT          4
-#define kQuote      6
-#define kCond       12
-#define kRead       17
-#define kPrint      22
-#define kAtom       28
-#define kCar        33
-#define kCdr        37
-#define kCons       41
-#define kEq         46
-
-#define M (RAM + sizeof(RAM) / sizeof(RAM[0]) / 2)
-#define S "NIL\0T\0QUOTE\0COND\0READ\0PRINT\0ATOM\0CAR\0CDR\0CONS\0EQ"
-
-int cx; /* stores negative memory use */
-int dx; /* stores lookahead character */
-int RAM[0100000]; /* your own ibm7090 */
-
-Intern() {
-  int i, j, x;
-  for (i = 0; (x = M[i++]);) {
-    for (j = 0;; ++j) {
-      if (x != RAM[j]) break;
-      if (!x) return i - j - 1;
-      x = M[i++];
-    }
-    while (x)
-      x = M[i++];
-  }
-  j = 0;
-  x = --i;
-  while ((M[i++] = RAM[j++]));
-  return x;
+#define kT          2
+#define kQuote      4
+#define kCond       7
+#define kRead       9
+#define kPrint      11
+#define kAtom       14
+#define kCar        16
+#define kCdr        18
+#define kCons       20
+#define kEq         22
+#define kSave       24
+#define kDump       28
+#define kLoad       30
+#define kUser       32
+#define kBufSiz     65536
+#define kSlots      2
+#define kQueue      4096
+#define kBatch      64
+#define kRing       1048576
+#define kNursery    4096
+
+#define kImageMagic   0x474d4953 /* "SIMG" */
+#define kImageVersion (4 | kSoa << 8)
+#define kSexpMagic    "\0SXB"
+
+#ifdef SOA
+#define kSoa 1
+#else
+#define kSoa 0
+#endif
+
+#ifndef RAMSIZE
+#define RAMSIZE 0100000
+#endif
+
+#if defined(IORING_FEAT_RW_CUR_POS) && defined(__NR_io_uring_setup) && \
+    !defined(NOURING)
+#define kUring 1
+#else
+#define kUring 0
+#endif
+
+#define N (sizeof(RAM) / sizeof(RAM[0]))
+#define kHash (sizeof(H) / sizeof(H[0]))
+#define M (RAM + N / 2)
+#define D (DRAM + N / 2) /* cdrs when built with -DSOA */
+#define W(n) (1 + ((n) + 3) / 4) /* ints used by symbol of n bytes */
+#define kCell (2 - kSoa) /* ints of M used by a cell */
+#define S "NIL\0T\0QUOTE\0COND\0READ\0PRINT\0ATOM\0CAR\0CDR\0CONS\0EQ\0SAVE-IMAGE\0DUMP\0LOAD"
+
+struct Reader {
+  unsigned char *a; /* stores where the input fed starts */
+  unsigned char *p, *e; /* stores unread input */
+  unsigned char *b; /* stores aligned 64 byte block holding p */
+  unsigned long long w, k; /* stores bits of block bytes <= ' ' and ')' */
+  int d, l; /* stores depth, and where the innermost list starts in v */
+  int *v, nv, zv; /* stores elements of open lists, their count, capacity */
+  int m; /* stores whether top-level lists are streamed */
+  int j; /* stores whether the rest of a form is being skipped */
+  int x; /* stores form that was read */
+  int *y, ny; /* stores atoms of binary input's symbols and their count */
+  char *t; /* stores token that spans inputs */
+  int n, z; /* stores its length and capacity */
+  int *g, ng, zg; /* stores #n= labels as number, depth or -1, object */
+  int np; /* stores how many labels wait for the object they're on */
+};
+
+__thread int cx; /* stores negative memory use */
+__thread int cf; /* stores lowest cell cx may reach */
+__thread jmp_buf cj; /* stores where to go when cells or symbols run out */
+__thread int ix; /* stores name of image to save */
+__thread struct Reader rx; /* stores reader state */
+__thread FILE *fx; /* stores input when not reading a terminal */
+__thread long mx; /* stores size of fx if it's mapped */
+__thread int wx; /* stores whether all input has been fed */
+__thread char *ib; /* stores input buffer */
+__thread FILE *ox; /* stores output */
+__thread char ob[kBufSiz]; /* stores output not yet written to ox */
+__thread int oy, ot; /* stores its length, and whether ox is a terminal */
+__thread long oz; /* stores bytes written to ox before ob */
+__thread int *kx, kn, kz; /* stores printer stack, its depth and capacity */
+__thread int *yx; /* stores references to each cell being printed, or ~label */
+__thread int *tx, tn, tz; /* stores cells counted in yx, their count, capacity */
+__thread jmp_buf ux; /* stores where to go at end of input */
+__thread int qx; /* stores whether Read takes forms read ahead */
+__thread long sn; /* stores requests served */
+int px; /* stores negative persistent memory use */
+int ax; /* stores persistent environment */
+int gx; /* stores function applied to each streamed record */
+int sx; /* stores symbol memory use after last collection */
+int ex; /* stores end of symbol table */
+int jx; /* stores number of worker threads */
+int nx; /* stores index of next file for a worker */
+int fc; /* stores number of files */
+int bx; /* stores number of files a worker loads at once */
+int lx; /* stores number of files loaded with io_uring */
+int vx; /* stores whether to report files per second */
+int zx; /* stores whether to print shared lists with labels */
+int hl, hd; /* stores most elements and nested lists to print, or 0 */
+long hb; /* stores most bytes to print of a result, or 0 */
+char **fv; /* stores files for workers */
+char **ov; /* stores output of each file */
+size_t *on; /* stores its length */
+int qr, qw, qe; /* stores forms taken, forms read ahead, end of input */
+int qg, qp; /* stores whether reading ahead should pause, and has */
+int qt; /* stores whether the main thread is waiting for a form */
+int qz; /* stores the main thread's cx while it waits */
+int qb; /* stores where the form being read ahead starts */
+int qo; /* stores whether that form has outgrown its slot */
+struct Reader *qy; /* stores reader state of the thread reading ahead */
+int qv[kQueue]; /* stores forms read ahead */
+int ql[kQueue], qh[kQueue]; /* stores their lowest and highest cells */
+char qd[kQueue]; /* stores whether each was dropped for want of memory */
+int qn[kSlots]; /* stores forms read into each staging slot */
+pthread_mutex_t qm = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t qc = PTHREAD_COND_INITIALIZER;
+char *wr; /* stores ring of output for the writer thread, if it's running */
+unsigned long wh, wt; /* stores bytes put in and taken out of wr */
+int wa, wb; /* stores whether the main thread waits for room, writer for bytes */
+pthread_mutex_t wm = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t wc = PTHREAD_COND_INITIALIZER;
+int sv; /* stores socket the server accepts connections on */
+int sf; /* stores number of server processes to fork, or 0 for threads */
+long sr; /* stores requests a server process serves before it's replaced */
+int sb; /* stores number of server threads answering a request */
+int sg; /* stores whether a server thread is collecting symbols */
+pthread_mutex_t sm = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t sc = PTHREAD_COND_INITIALIZER;
+int RAM[RAMSIZE]; /* your own ibm7090 */
+int H[RAMSIZE / 2]; /* open addressed index of symbol offsets */
+#ifdef SOA
+int DRAM[RAMSIZE / 2 + 2];
+#endif
+
+/*
+ * Symbols are stored as a byte length followed by the name packed four
+ * bytes to an int, zero padded, and the table ends at a zero length.
+ * NIL has no entry: M[0] and M[1] stay zero so its CAR and CDR are NIL.
+ * H maps name hashes to offsets with linear probing; it has a slot for
+ * every two ints of M so it never fills before the table does.
+ */
+Hash(p, n) unsigned char *p; {
+  unsigned h = 2166136261;
+  while (n--) h = (h ^ *p++) * 16777619;
+  return h % kHash;
+}
+
+/*
+ * Intern is lock-free so interpreter threads may share one table. A new
+ * symbol reserves its ints by bumping ex, is written in full, and only
+ * then published by swapping its offset into an empty slot of H, so a
+ * lookup never waits and never sees half a name. A thread that loses
+ * the swap to the same name blanks its reservation and takes the other
+ * offset, leaving a hole that Rehash skips and GcSymbols reclaims.
+ * Offsets are stable until GcSymbols, which needs the other threads idle.
+ * A name that won't fit before the end of M, less the zero length that
+ * ends the table, is Exhausted, like a cell that won't fit.
+ */
+Intern(p, n) char *p; {
+  int i, x, y;
+  if (n == 3 && !memcmp(p, "NIL", 3)) return 0;
+  for (y = 0, i = Hash(p, n);; i = (i + 1) % kHash) {
+    if (!(x = __atomic_load_n(H + i, __ATOMIC_ACQUIRE))) {
+      if (!y) {
+        y = __atomic_load_n(&ex, __ATOMIC_RELAXED);
+        do if (y + W(n) >= N / 2) Exhausted();
+        while (!__atomic_compare_exchange_n(&ex, &y, y + W(n), 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+        if (n) M[y + W(n) - 1] = 0;
+        M[y] = n;
+        memcpy(M + y + 1, p, n);
+      }
+      if (__atomic_compare_exchange_n(H + i, &x, y, 0, __ATOMIC_RELEASE,
+                                      __ATOMIC_ACQUIRE)) {
+        return y;
+      }
+    }
+    if (M[x] == n && !memcmp(M + x + 1, p, n)) {
+      if (y) memset(M + y + 1, 0, n);
+      return x;
+    }
+  }
+}
+
+Rehash() {
+  int i, x;
+  memset(H, 0, sizeof(H));
+  for (x = kT; x < ex; x += W(M[x])) {
+    if (M[x] && !*(char *)(M + x + 1)) continue; /* hole */
+    for (i = Hash(M + x + 1, M[x]); H[i]; i = (i + 1) % kHash);
+    H[i] = x;
+  }
+}
+
+/*
+ * The reader is pushed input in chunks of any size with Feed and Parse
+ * returns each top-level form as it closes, or 0 once the chunk is used
+ * up partway through one, so it can be driven from an event loop. All
+ * of its state is in a struct Reader. A partial form's cells live in
+ * the caller's nursery, so cx may only be reset between forms.
+ *
+ * Lists are built with an explicit stack instead of recursion, so long
+ * or deeply nested input needs no C stack. The elements of open lists
+ * are pushed onto v, which is malloc'd rather than consed so a form
+ * costs no more cells than it holds. An open paren pushes where the
+ * enclosing list starts and l then marks the start of the new one. A
+ * close paren conses its elements up last to first, so cells only point
+ * at older cells like everywhere else.
+ *
+ * If memory runs out partway through a form, j is set and the rest of
+ * the form is read without consing or interning anything, so the next
+ * form is read from where it starts.
+ *
+ * Tokens are interned straight from the input, except for one that
+ * runs off the end of a chunk, which is copied to t until it ends.
+ *
+ * When m is set, top-level lists are streamed: their elements come out
+ * one at a time as if they were top-level forms and the list itself is
+ * never built, so a list of records needn't fit in memory.
+ *
+ * A token #n= labels the object after it at the same depth, and a later
+ * #n# in the same form reads as that very object, so shared structure
+ * printed with --shared reads back shared. Only objects already read
+ * can be referred to, since cells can't be changed once they're made.
+ * Any other use of such a token reads as a symbol.
+ */
+
+Feed(r, p, n) struct Reader *r; unsigned char *p; {
+  r->a = r->p = p;
+  r->e = p + n;
+  r->b = 0;
+}
+
+/*
+ * Classify classifies the aligned 64 byte block holding q in bulk, so
+ * Scan can find token boundaries by counting zeros. Bytes past the end
+ * of input count as both whitespace and delimiters. A block that starts
+ * before the input or ends after it is classified a byte at a time, so
+ * nothing outside the input is read; bits for bytes before it are
+ * shifted out by Scan, which only looks from q on.
+ */
+Classify(r, q) struct Reader *r; unsigned char *q; {
+  int i;
+  unsigned char *b;
+  r->b = b = (unsigned char *)((unsigned long)q & -64);
+  if (b < r->a || b + 64 > r->e) {
+    r->w = r->k = 0;
+    for (i = b < r->a ? r->a - b : 0; i < 64; ++i) {
+      if (b + i >= r->e || b[i] <= ' ') r->w |= 1ull << i;
+      if (b + i >= r->e || b[i] <= ')') r->k |= 1ull << i;
+    }
+    return;
+  }
+#ifdef __AVX2__
+  for (r->w = r->k = i = 0; i < 64; i += 32) {
+    __m256i v = _mm256_load_si256((__m256i *)(b + i));
+    r->w |= (unsigned long long)(unsigned)_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(' ')), v)) << i;
+    r->k |= (unsigned long long)(unsigned)_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(')')), v)) << i;
+  }
+#elif defined(__SSE2__)
+  for (r->w = r->k = i = 0; i < 64; i += 16) {
+    __m128i v = _mm_load_si128((__m128i *)(b + i));
+    r->w |= (unsigned long long)_mm_movemask_epi8(_mm_cmpeq_epi8(
+        _mm_min_epu8(v, _mm_set1_epi8(' ')), v)) << i;
+    r->k |= (unsigned long long)_mm_movemask_epi8(_mm_cmpeq_epi8(
+        _mm_min_epu8(v, _mm_set1_epi8(')')), v)) << i;
+  }
+#else
+  for (r->w = r->k = i = 0; i < 64; ++i) {
+    if (b[i] <= ' ') r->w |= 1ull << i;
+    if (b[i] <= ')') r->k |= 1ull << i;
+  }
+#endif
 }
 
-GetChar() {
-  int c, t;
-  static char *l, *p;
-  if (l || (l = p = bestlineWithHistory("* ", "sectorlisp"))) {
-    if (*p) {
-      c = *p++ & 255;
+/* returns first byte from q that isn't whitespace, or is a delimiter */
+unsigned char *Scan(r, q, delim) struct Reader *r; unsigned char *q; {
+  unsigned long long m;
+  for (; q < r->e; q = r->b + 64) {
+    if ((unsigned long)(q - r->b) >= 64) Classify(r, q);
+    if ((m = (delim ? r->k : ~r->w) >> (q - r->b)))
+      return q + __builtin_ctzll(m);
+  }
+  return r->e;
+}
+
+Save(r, p, n) struct Reader *r; char *p; {
+  if (r->n + n > r->z) r->t = realloc(r->t, r->z = (r->n + n) * 2);
+  memcpy(r->t + r->n, p, n);
+  r->n += n;
+}
+
+/* pushes x onto the elements of r's open lists */
+Push(r, x) struct Reader *r; {
+  if (r->nv == r->zv)
+    r->v = realloc(r->v, (r->zv = r->zv * 2 + 64) * sizeof(int));
+  r->v[r->nv++] = x;
+}
+
+/* interns a token, unless it's in a form that's being skipped */
+Token(r, p, n) struct Reader *r; char *p; {
+  return r->j ? 0 : Intern(p, n);
+}
+
+/* gives x to the labels waiting at its depth */
+Bind(r, x) struct Reader *r; {
+  int i;
+  for (i = r->ng; i; i -= 3) {
+    if (r->g[i - 2] == r->d) {
+      r->g[i - 2] = -1;
+      r->g[i - 1] = x;
+      --r->np;
+    }
+  }
+}
+
+/* adds x to the open list, or returns 1 with it in r->x if it's a form */
+Emit(r, x) struct Reader *r; {
+  if (r->np) Bind(r, x);
+  if (r->d <= r->m) {
+    r->ng = r->np = 0;
+    if (r->j) return r->j = 0; /* the end of a form that was given up on */
+    return r->x = x, 1;
+  }
+  Push(r, x);
+  return 0;
+}
+
+/*
+ * handles a #n= or #n# label at the start of the token saved in t, which
+ * ends at the delimiter r->p, returning 1 if it completes a form, 0 if it
+ * doesn't, or -1 if it isn't a label
+ */
+Label(r) struct Reader *r; {
+  int i, v;
+  for (v = 0, i = 1; i < r->n && i < 10 && isdigit(r->t[i]); ++i)
+    v = v * 10 + r->t[i] - '0';
+  if (i == 1 || i > r->n) return -1;
+  if (i < r->n && r->t[i] == '=') {
+    if (r->ng + 3 > r->zg)
+      r->g = realloc(r->g, (r->zg = r->ng * 2 + 24) * sizeof(int));
+    r->g[r->ng++] = v;
+    r->g[r->ng++] = r->d;
+    r->g[r->ng++] = 0;
+    ++r->np;
+    memmove(r->t, r->t + i + 1, r->n -= i + 1);
+    return 0;
+  }
+  if (i == r->n && *r->p == '#') {
+    for (i = r->ng; i; i -= 3) {
+      if (r->g[i - 3] == v && r->g[i - 2] == -1) {
+        r->n = 0;
+        ++r->p;
+        return Emit(r, r->g[i - 1]);
+      }
+    }
+  }
+  return -1;
+}
+
+/* interns the token saved in t, or just its leading # if it has one */
+Saved(r) struct Reader *r; {
+  int n;
+  if (*r->t == '#') {
+    memmove(r->t, r->t + 1, --r->n);
+    return Token(r, "#", 1);
+  }
+  n = r->n;
+  r->n = 0;
+  return Token(r, r->t, n);
+}
+
+Parse(r) struct Reader *r; {
+  int c, i, x;
+  unsigned char *q;
+  for (;;) {
+    if (r->n) {
+      q = Scan(r, r->p, 1);
+      Save(r, r->p, q - r->p);
+      if ((r->p = q) == r->e) return 0;
+      if (*r->t == '#' && (c = Label(r)) != -1) {
+        if (c) return 1;
+        continue;
+      }
+      x = Saved(r);
     } else {
-      free(l);
-      l = p = 0;
-      c = '\n';
+      if ((q = Scan(r, r->p, 0)) == r->e) return r->p = q, 0;
+      r->p = q + 1;
+      if ((c = *q) == '(') {
+        if (r->m && !r->d) {
+          r->d = 1;
+          continue;
+        }
+        Push(r, r->l);
+        r->l = r->nv;
+        ++r->d;
+        continue;
+      }
+      if (c == ')' && r->m && r->d == 1) {
+        --r->d;
+        continue;
+      }
+      if (c == ')' && r->d) {
+        if (cx - (r->nv - r->l) * kCell < cf) Widen(r);
+        /* closed before consing, so running out leaves nothing open */
+        i = r->nv;
+        r->nv = r->l - 1;
+        r->l = r->v[r->nv];
+        --r->d;
+        for (x = 0; !r->j && i > r->nv + 1;) x = Cons(r->v[--i], x);
+      } else if (c == '#') {
+        r->p = Scan(r, r->p, 1); /* saved so it's looked at for a label */
+        Save(r, q, r->p - q);
+        continue;
+      } else if (c <= ')') {
+        x = Token(r, q, 1);
+      } else if ((r->p = Scan(r, r->p, 1)) == r->e) {
+        Save(r, q, r->p - q);
+        return 0;
+      } else {
+        x = Token(r, q, r->p - q);
+      }
     }
-    t = dx;
-    dx = c;
-    return t;
+    if (Emit(r, x)) return 1;
+  }
+}
+
+/* ends input, returning 1 if a trailing token completes a form */
+Finish(r) struct Reader *r; {
+  while (r->n) {
+    if (Emit(r, Saved(r))) return 1;
+  }
+  return 0;
+}
+
+Reset(r) struct Reader *r; {
+  r->d = r->l = r->nv = r->n = r->ng = r->np = r->j = 0;
+  free(r->y);
+  r->y = 0;
+  Feed(r, 0, 0);
+}
+
+/*
+ * Read pulls input for rx until it has a form. Terminal input comes
+ * through bestline a line at a time, with history. Anything else, be it
+ * a pipe, a file given by -f or a worker's file, is read from fx in
+ * large blocks with no prompts, no terminal probing and no history file
+ * traffic. Regular files are mapped instead and fed in one piece, and
+ * binary input that isn't a regular file is read in full, since a form
+ * is only decoded once all of it is in memory.
+ */
+
+MapInput() {
+  off_t o;
+  struct stat st;
+  unsigned char *p;
+  if (fstat(fileno(fx), &st) == -1 || !S_ISREG(st.st_mode) ||
+      (o = lseek(fileno(fx), 0, SEEK_CUR)) == -1 || o >= st.st_size ||
+      (p = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fileno(fx), 0)) ==
+          MAP_FAILED) {
+    return mx = 0;
+  }
+  madvise(p, st.st_size, MADV_SEQUENTIAL);
+  if (o) {
+    Feed(&rx, p + o, st.st_size - o);
   } else {
-    PrintChar('\n');
-    exit(0);
+    FeedAll(p, st.st_size);
   }
+  return mx = st.st_size;
 }
 
-PrintChar(b) {
-  fputwc(b, stdout);
+/* feeds rx all of the input at p, which may be binary */
+FeedAll(p, n) unsigned char *p; {
+  Feed(&rx, p, n);
+  wx = 1;
+  if (n >= 4 && !memcmp(p, kSexpMagic, 4) && !Header(&rx)) {
+    fprintf(stderr, "bad binary input\n");
+    exit(1);
+  }
 }
 
-GetToken() {
-  int c, i = 0;
-  do if ((c = GetChar()) > ' ') RAM[i++] = c;
-  while (c <= ' ' || (c > ')' && dx > ')'));
-  RAM[i] = 0;
-  return c;
+/* feeds rx the start of fx, or all of it if it's binary */
+OpenInput() {
+  int k, n, z;
+  unsigned char *p;
+  if (MapInput()) return;
+  if (!ib) ib = malloc(kBufSiz);
+  for (n = 0; n < 4 && (k = read(fileno(fx), ib + n, kBufSiz - n)) > 0;)
+    n += k;
+  if (n < 4 || memcmp(ib, kSexpMagic, 4)) {
+    Feed(&rx, ib, n);
+    return;
+  }
+  p = malloc(z = kBufSiz * 2);
+  memcpy(p, ib, n);
+  while ((k = read(fileno(fx), p + n, z - n)) > 0) {
+    if ((n += k) == z) p = realloc(p, z *= 2);
+  }
+  FeedAll(p, n);
 }
 
-AddList(x) {
-  return Cons(x, GetList());
+Refill() {
+  int n;
+  if (wx) return 0;
+  if (fx) {
+    if (!ib) ib = malloc(kBufSiz);
+    if (qy == &rx) Wake(); /* read(2) may block, so hand over what we have */
+    if ((n = read(fileno(fx), ib, kBufSiz)) <= 0) return 0;
+  } else {
+    free(ib);
+    PrintFlush();
+    Sync();
+    if (!(ib = bestlineWithHistory("* ", "sectorlisp"))) return 0;
+    n = strlen(ib);
+    ib[n++] = '\n';
+  }
+  Feed(&rx, ib, n);
+  return 1;
 }
 
-GetList() {
-  int c = GetToken();
-  if (c == ')') return 0;
-  return AddList(GetObject(c));
+/* evaluates x, or applies gx to it as a streamed record */
+Run(x) {
+  if (gx) return Apply(gx, Cons(x, 0), ax);
+  return Eval(x, ax);
 }
 
-GetObject(c) {
-  if (c == '(') return GetList();
-  return Intern();
+/* evaluates the next form, or applies gx to the next streamed record */
+Step() {
+  return Run(Read());
 }
 
-Read() {
-  return GetObject(GetToken());
+EndOfInput() {
+  longjmp(ux, 1);
 }
 
-PrintAtom(x) {
-  int c;
+/*
+ * Each thread's cells stop at cf and symbols at the end of M, so a form
+ * too big for what's left is given up on, rather than writing over some
+ * other thread's cells or the hash index. Whoever runs the thread says
+ * where to go from there with cj: the REPL reports it and goes on with
+ * the next form, a worker gives up on its file and the reader thread on
+ * reading ahead.
+ */
+
+/* gives up on the form being read or evaluated, for want of memory */
+Exhausted() {
+  longjmp(cj, 1);
+}
+
+/* has rx skip the rest of the form it was reading when memory ran out */
+Abandon() {
+  if (rx.d > rx.m || rx.n) rx.j = 1;
+}
+
+/* reports that the REPL's form ran out of memory and goes on to the next */
+Recover() {
+  Resume(); /* in case it ran out persisting an image */
+  Abandon();
+  PrintFlush();
+  fflush(stdout);
+  Sync();
+  fprintf(stderr, "out of memory\n");
+}
+
+Read() {
+  if (qx) return Take();
+  if (rx.y) {
+    if (rx.p == rx.e) EndOfInput();
+    if (Decode(&rx)) return rx.x;
+    fprintf(stderr, "bad binary input\n");
+    EndOfInput();
+  }
   for (;;) {
-    if (!(c = M[x++])) break;
-    PrintChar(c);
+    if (Parse(&rx)) return rx.x;
+    if (!Refill()) {
+      if (Finish(&rx)) return rx.x;
+      EndOfInput();
+    }
   }
 }
 
-PrintList(x) {
-  PrintChar('(');
-  PrintObject(Car(x));
-  while ((x = Cdr(x))) {
-    if (x < 0) {
-      PrintChar(' ');
-      PrintObject(Car(x));
-    } else {
-      PrintChar(L'∙');
-      PrintObject(x);
-      break;
+/* writes n bytes at p to ox, or hands stdout's to the writer thread */
+PrintWrite(p, n) char *p; {
+  if (wr && ox == stdout) {
+    Put(p, n);
+  } else {
+    fwrite(p, 1, n, ox);
+  }
+  oz += n;
+}
+
+/* writes buffered output to ox */
+PrintFlush() {
+  PrintWrite(ob, oy);
+  oy = 0;
+  if (ot && !wr) fflush(ox);
+}
+
+/* buffers b as UTF-8, which only the dot of dotted pairs needs */
+PrintChar(b) {
+  if (oy + 3 > kBufSiz) PrintFlush();
+  if (b < 0200) {
+    ob[oy++] = b;
+  } else if (b < 04000) {
+    ob[oy++] = 0300 | b >> 6;
+    ob[oy++] = 0200 | b & 077;
+  } else {
+    ob[oy++] = 0340 | b >> 12;
+    ob[oy++] = 0200 | b >> 6 & 077;
+    ob[oy++] = 0200 | b & 077;
+  }
+}
+
+/* copies up to k bytes of atom x as they were read, returning if all fit */
+PrintAtom(x, k) long k; {
+  int n, m;
+  char *p;
+  if (x) {
+    /* names are only what the table holds, whatever x came from */
+    n = x < ex && M[x] >= 0 && M[x] <= (ex - x - 1) * 4 ? M[x] : 0;
+    p = M + x + 1;
+  } else {
+    n = 3;
+    p = "NIL";
+  }
+  m = n < k ? n : k;
+  if (oy + m > kBufSiz) PrintFlush();
+  if (m > kBufSiz) {
+    PrintWrite(p, m);
+  } else {
+    memcpy(ob + oy, p, m);
+    oy += m;
+  }
+  return m == n;
+}
+
+/*
+ * Lists are printed with an explicit stack instead of recursion, so a
+ * long or deeply nested result needs no C stack. Each open list keeps
+ * the rest of its cells on kx, or 0 once only its close paren is left,
+ * along with how many of its elements have been printed.
+ *
+ * --print-length, --print-depth and --print-bytes limit how much of a
+ * result is printed. What's left out is marked with ... in place of
+ * the rest of a list, a list nested too deep, or the rest of the output
+ * once it has used its bytes, when printing stops without closing any
+ * lists. Limits are checked as printing goes, so an oversized result
+ * costs no more than what gets printed.
+ *
+ * With --shared, Print first counts the references to every list it
+ * will reach and a list referenced more than once is printed in full
+ * the first time as #n= followed by it, then as #n# after that, which
+ * the reader reads back as the same cells. So a result that shares
+ * structure prints in size proportional to its distinct cells, rather
+ * than to the tree it unfolds into. Cells only point at older cells,
+ * so there are never any cycles, and only lists in car position get
+ * labels because the reader has no syntax for a dotted tail. Counting
+ * keeps to the length and depth limits, so it too stays within them.
+ */
+
+/* makes room on the printer stack for n more entries */
+Reserve(n) {
+  if (kn + n > kz) kx = realloc(kx, (kz = (kn + n) * 2) * sizeof(int));
+}
+
+/* counts the references to x and the lists in it into yx */
+Count(x) {
+  int d, i, y;
+  Reserve(2);
+  kx[kn++] = x;
+  for (kx[kn++] = 0; kn;) {
+    d = kx[--kn];
+    if ((x = kx[--kn]) >= 0 || (hd && d >= hd) || yx[-x]++) continue;
+    if (tn == tz) tx = realloc(tx, (tz = tn * 2 + 64) * sizeof(int));
+    tx[tn++] = x;
+    for (i = 0, y = x; y < 0 && (!hl || i < hl); ++i, y = Cdr(y)) {
+      Reserve(2);
+      kx[kn++] = Car(y);
+      kx[kn++] = d + 1;
     }
   }
-  PrintChar(')');
 }
 
+PrintInt(n) {
+  char b[12];
+  int i = sizeof(b);
+  do b[--i] = '0' + n % 10;
+  while ((n /= 10));
+  while (i < sizeof(b)) PrintChar(b[i++]);
+}
+
+PrintLabel(n, c) {
+  PrintChar('#');
+  PrintInt(n);
+  PrintChar(c);
+}
+
+PrintElision() {
+  PrintChar('.');
+  PrintChar('.');
+  PrintChar('.');
+}
+
+/* prints x without recursion, labelling shared lists if yx is counted */
 PrintObject(x) {
-  if (x < 0) {
-    PrintList(x);
-  } else {
-    PrintAtom(x);
+  int b, c, l;
+  long e;
+  e = hb ? oz + oy + hb : LONG_MAX;
+  for (b = kn, l = 0;;) {
+    if (oz + oy >= e) break;
+    if (x < 0 && tn && yx[-x] < 0) {
+      PrintLabel(~yx[-x], '#');
+    } else if (x < 0 && hd && (kn - b) / 2 >= hd) {
+      PrintElision();
+    } else if (x < 0) {
+      if (tn && yx[-x] > 1) {
+        yx[-x] = ~l;
+        PrintLabel(l++, '=');
+      }
+      PrintChar('(');
+      Reserve(2);
+      kx[kn++] = Cdr(x);
+      kx[kn++] = 1;
+      x = Car(x);
+      continue;
+    } else if (!PrintAtom(x, e - oz - oy)) {
+      break;
+    }
+    for (;;) {
+      if (kn == b) return;
+      if (oz + oy >= e) break;
+      c = kx[--kn];
+      if (!(x = kx[--kn])) {
+        PrintChar(')');
+        continue;
+      }
+      kx[kn++] = 0;
+      kx[kn++] = c + 1;
+      if (x > 0) {
+        PrintChar(L'∙');
+      } else if (hl && c >= hl) {
+        PrintChar(' ');
+        PrintElision();
+        continue;
+      } else {
+        PrintChar(' ');
+        kx[kn - 2] = Cdr(x);
+        x = Car(x);
+      }
+      break;
+    }
+    if (kn > b && oz + oy >= e) break;
   }
+  PrintElision();
+  kn = b;
 }
 
 Print(e) {
-  PrintObject(e);
+  if (zx) {
+    if (!yx) yx = calloc(N / 2 + 1, sizeof(int));
+    Count(e);
+    PrintObject(e);
+    while (tn) yx[-tx[--tn]] = 0;
+  } else {
+    PrintObject(e);
+  }
 }
 
 PrintNewLine() {
   PrintChar('\n');
+  if (ot) PrintFlush();
 }
 
 /*───────────────────────────────────────────────────────────────────────────│─╗
 │ The LISP Challenge § Bootstrap John McCarthy's Metacircular Evaluator    ─╬─│┼
 ╚────────────────────────────────────────────────────────────────────────────│*/
 
+/*
+ * Cells normally interleave car and cdr as M[x] and M[x+1]. Building
+ * with -DSOA keeps cdrs in a parallel array D instead, so each cell
+ * takes one index and walks over just cars or just cdrs touch half the
+ * cache lines.
+ */
+
 Car(x) {
   return M[x];
 }
 
 Cdr(x) {
+#ifdef SOA
+  return D[x];
+#else
   return M[x + 1];
+#endif
 }
 
 Cons(car, cdr) {
+  if (cx - kCell < cf) Exhausted();
+#ifdef SOA
+  D[--cx] = cdr;
+  M[cx] = car;
+#else
   M[--cx] = cdr;
   M[--cx] = car;
+#endif
   return cx;
 }
 
+Move(a, b) {
+  M[a] = M[b];
+#ifdef SOA
+  D[a] = D[b];
+#endif
+}
+
 Gc(x, m, k) {
   return x < m ? Cons(Gc(Car(x), m, k), 
                       Gc(Cdr(x), m, k)) + k : x;
@@ -208,13 +903,16 @@ Evcon(c, a) {
 
 Apply(f, x, a) {
   if (f < 0)       return Eval(Car(Cdr(Cdr(f))), Pairlis(Car(Cdr(f)), x, a));
-  if (f > kEq)     return Apply(Eval(f, a), x, a);
+  if (f > kLoad)   return Apply(Eval(f, a), x, a);
+  if (f == kLoad)  return Load(Car(x));
+  if (f == kDump)  return Dump(Car(x), Car(Cdr(x)));
+  if (f == kSave)  return ix = Car(x), Car(Cdr(x));
   if (f == kEq)    return Car(x) == Car(Cdr(x)) ? kT : 0;
   if (f == kCons)  return Cons(Car(x), Car(Cdr(x)));
   if (f == kAtom)  return Car(x) < 0 ? 0 : kT;
-  if (f == kCar)   return Car(Car(x));
-  if (f == kCdr)   return Cdr(Car(x));
-  if (f == kRead)  return Read();
+  if (f == kCar)   return Car(x) < 0 ? Car(Car(x)) : 0;
+  if (f == kCdr)   return Car(x) < 0 ? Cdr(Car(x)) : 0;
+  if (f == kRead)  return Sync(), Read();
   if (f == kPrint) return (x ? Print(Car(x)) : PrintNewLine()), 0;
 }
 
@@ -234,23 +932,1341 @@ Eval(e, a) {
   e = Gc(e, A, A - B);
   C = cx;
   while (C < B)
-    M[--A] = M[--B];
+    Move(--A, --B);
   cx = A;
   return e;
 }
 
 /*───────────────────────────────────────────────────────────────────────────│─╗
-│ The LISP Challenge § User Interface                                      ─╬─│┼
+│ The LISP Challenge § Heap Images                                         ─╬─│┼
+╚────────────────────────────────────────────────────────────────────────────│*/
+
+/*
+ * An image holds the persistent cells M[px..0) followed by the symbol
+ * table M[0..n). Both are addressed relative to M so images load into
+ * any build with the same kImageVersion and builtin symbols. Builds
+ * with -DSOA append the cdrs D[px..0) as well.
+ *
+ *   int magic, version, cells, symbols, environment, checksum;
+ *   int memory[cells + symbols + kSoa * cells];
+ *
+ * The checksum covers the header before it as well as memory, and an
+ * image is only loaded once every cell and symbol in it is in bounds.
+ */
+
+Symbols() {
+  return ex + 1;
+}
+
+Checksum(h, p, n) unsigned h; int *p; {
+  while (n--) h = (h ^ *p++) * 16777619;
+  return h;
+}
+
+/* marks atom *p in T, or renumbers it once T maps old offsets to new */
+Atom(T, p, f) int *T, *p; {
+  if (*p < kUser) return;
+  if (f) {
+    *p = T[*p];
+  } else {
+    T[*p] = 1;
+  }
+}
+
+/* does Atom to the atoms of cells [a,b) */
+Atoms(T, a, b, f) int *T; {
+  for (; a < b; ++a) {
+    Atom(T, M + a, f);
+#ifdef SOA
+    Atom(T, D + a, f);
+#endif
+  }
+}
+
+/* does Atom to every atom that symbol collection must keep */
+Roots(T, f) int *T; {
+  int i, j;
+  Atoms(T, px, 0, f);
+  Atom(T, &ax, f);
+  Atom(T, &gx, f);
+  for (j = qr; j < qw; ++j) {
+    i = j % kQueue;
+    Atom(T, qv + i, f);
+    Atoms(T, ql[i], qh[i], f);
+  }
+  if (qy) {
+    for (i = 0; i < qy->ny; ++i) Atom(T, qy->y + i, f);
+  }
+  if (rx.y) {
+    for (i = 0; i < rx.ny; ++i) Atom(T, rx.y + i, f);
+  }
+}
+
+/* returns whether symbols have grown enough to be worth collecting */
+Due() {
+  /* rehashing costs O(N) so wait till symbols fill a quarter of M */
+  return Symbols() > sx * 2 && Symbols() > N / 8;
+}
+
+GcSymbols() {
+  int i, j, n, w, *T;
+  n = Symbols();
+  if (N / 2 + px < 2 * n || (qx && px - n < Stage(kSlots - 1))) return n;
+  T = M + px - n;
+  memset(T, 0, n * sizeof(int));
+  Roots(T, 0);
+  for (j = i = kUser; i < ex; i += w) {
+    w = W(M[i]);
+    if (T[i]) {
+      T[i] = j;
+      memmove(M + j, M + i, w * sizeof(int));
+      j += w;
+    }
+  }
+  memset(M + j, 0, (i - j + 1) * sizeof(int));
+  Roots(T, 1);
+  ex = j;
+  Rehash();
+  return j + 1;
+}
+
+Persist(e) {
+  int A, B, C;
+  A = 0;
+  B = cx;
+  e = Gc(e, A, A - B);
+  C = cx;
+  while (C < B)
+    Move(--A, --B);
+  px = cx = A;
+  return e;
+}
+
+/* copies name of atom x to p, returning 0 if it's too long */
+GetName(x, p) char *p; {
+  if (x < 0 || M[x] >= PATH_MAX) return 0;
+  memcpy(p, M + x + 1, M[x]);
+  p[M[x]] = 0;
+  return 1;
+}
+
+SaveImage(x) {
+  FILE *f;
+  int h[6];
+  char p[PATH_MAX];
+  if (!GetName(x, p)) return;
+  h[0] = kImageMagic;
+  h[1] = kImageVersion;
+  h[2] = -px;
+  h[3] = Symbols();
+  h[4] = ax;
+  h[5] = Checksum(Checksum(2166136261, h, 5), M + px, h[2] + h[3]);
+#ifdef SOA
+  h[5] = Checksum(h[5], D + px, h[2]);
+#endif
+  if (!(f = fopen(p, "wb")) ||
+      fwrite(h, sizeof(h), 1, f) != 1 ||
+      fwrite(M + px, sizeof(int), h[2] + h[3], f) != h[2] + h[3] ||
+#ifdef SOA
+      fwrite(D + px, sizeof(int), h[2], f) != h[2] ||
+#endif
+      fclose(f)) {
+    perror(p);
+  }
+}
+
+/* returns whether x is in an image with c ints of cells, and symbols
+   that end at e */
+Bounded(x, c, e) {
+  return x < 0 ? x >= -c && !(x % kCell) : x < e;
+}
+
+/* returns whether image h's environment, cells and symbols are in bounds */
+Sane(h) int *h; {
+  int i, c, e, *m;
+  c = h[2];
+  e = h[3] - 1;
+  m = h + 6 + c; /* as M */
+  if (h[4] > 0 || !Bounded(h[4], c, e)) return 0;
+  for (i = kT; i < e; i += W(m[i])) {
+    if (m[i] <= 0 || m[i] > (e - i - 1) * 4) return 0;
+  }
+  if (i != e || m[e]) return 0;
+  for (i = -c; i < 0; ++i) {
+    if (!Bounded(m[i], c, e)) return 0;
+#ifdef SOA
+    if (!Bounded(m[e + 1 + c + i], c, e)) return 0;
+#endif
+  }
+  return 1;
+}
+
+LoadImage(p) char *p; {
+  int i, fd, *h;
+  struct stat st;
+  if ((fd = open(p, O_RDONLY)) == -1 || fstat(fd, &st) == -1 ||
+      (h = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+    perror(p);
+    exit(1);
+  }
+  close(fd);
+  if (st.st_size >= sizeof(int) * 2 && h[0] == kImageMagic &&
+      h[1] == (kImageVersion ^ 1 << 8)) {
+    fprintf(stderr, "%s: image is for a build %s -DSOA\n", p,
+            kSoa ? "without" : "with");
+    exit(1);
+  }
+  if (st.st_size < sizeof(int) * 6 ||
+      h[0] != kImageMagic || h[1] != kImageVersion ||
+      h[2] < 0 || h[2] > N / 2 || h[2] % kCell ||
+      h[3] <= kUser || h[3] > N / 2 ||
+      st.st_size != (6 + h[2] + h[3] + kSoa * h[2]) * sizeof(int) ||
+      Checksum(Checksum(2166136261, h, 5), h + 6,
+               h[2] + h[3] + kSoa * h[2]) != h[5] ||
+      !Sane(h)) {
+    fprintf(stderr, "%s: bad image\n", p);
+    exit(1);
+  }
+  if (memcmp(h + 6 + h[2], M, kUser * sizeof(int))) {
+    fprintf(stderr, "%s: builtins differ\n", p);
+    exit(1);
+  }
+  px = -h[2];
+  ax = h[4];
+  ex = h[3] - 1;
+  memcpy(M + px, h + 6, (h[2] + h[3]) * sizeof(int));
+#ifdef SOA
+  memcpy(D + px, h + 6 + h[2] + h[3], h[2] * sizeof(int));
+#endif
+  munmap(h, st.st_size);
+  Rehash();
+}
+
+/*───────────────────────────────────────────────────────────────────────────│─╗
+│ The LISP Challenge § Binary S-Expressions                                ─╬─│┼
 ╚────────────────────────────────────────────────────────────────────────────│*/
 
-main() {
+/*
+ * Binary s-expressions spare the reader from tokenizing and interning
+ * every atom again. A file is a symbol table and then forms, each one
+ * its cell count followed by a preorder walk of its nodes, all varints:
+ *
+ *   "\0SXB" symbols (length name)... (cells node...)...
+ *   node: 0      NIL
+ *         1      cell whose car then cdr follow
+ *         2n+1   list of n > 0 elements that follow, ending in NIL
+ *         2i+2   symbol i
+ *
+ * Decode interns the table once and then writes each form's cells
+ * straight into M in preorder, root lowest, so cells still only point
+ * at older cells. Slots waiting for a node are stacked below them as
+ * 2*cell for the car or 2*cell+1 for the cdr. Shared structure is
+ * written out once per reference.
+ */
+
+struct Writer {
+  FILE *f; /* stores forms */
+  char *b; /* stores their bytes */
+  size_t n; /* stores their length */
+  int *id; /* stores 1 + symbol index of each atom used */
+  int *sym, ns; /* stores atoms used in symbol order and their count */
+  int *k, nk; /* stores stack of nodes to walk and its capacity */
+};
+
+PutVarint(f, v) FILE *f; unsigned v; {
+  for (; v > 127; v >>= 7) putc((v & 127) | 128, f);
+  putc(v, f);
+}
+
+GetVarint(r) struct Reader *r; {
   int i;
+  unsigned v;
+  for (v = i = 0; r->p < r->e && i < 32; i += 7) {
+    v |= (*r->p & 127) << i;
+    if (!(*r->p++ & 128)) return v;
+  }
+  return -1;
+}
+
+/* walks x in preorder, counting cells, or writing nodes when emit */
+Walk(w, x, emit) struct Writer *w; {
+  int c, i, l, n, y;
+  for (c = 0, n = 1, w->k[0] = x; n;) {
+    x = w->k[--n];
+    if (x < 0) {
+      for (l = 1, y = Cdr(x); y < 0; y = Cdr(y)) ++l;
+      if (y) l = 1;
+      if (n + l + 1 > w->nk)
+        w->k = realloc(w->k, (w->nk = (n + l + 1) * 2) * sizeof(int));
+      if (y) w->k[n++] = Cdr(x);
+      for (n += l, i = 1, y = x; i <= l; ++i, y = Cdr(y)) w->k[n - i] = Car(y);
+      if (emit) PutVarint(w->f, y ? 1 : 2 * l + 1);
+      c += l;
+    } else if (emit) {
+      if (x && !w->id[x]) {
+        w->sym[w->ns++] = x;
+        w->id[x] = w->ns;
+      }
+      PutVarint(w->f, x ? 2 * w->id[x] : 0);
+    }
+  }
+  return c;
+}
+
+Begin(w) struct Writer *w; {
+  w->f = open_memstream(&w->b, &w->n);
+  w->id = calloc(N / 2, sizeof(int));
+  w->sym = malloc(N / 2 * sizeof(int));
+  w->k = malloc((w->nk = 64) * sizeof(int));
+  w->ns = 0;
+}
+
+Encode(w, x) struct Writer *w; {
+  PutVarint(w->f, Walk(w, x, 0));
+  Walk(w, x, 1);
+}
+
+/* writes what w has encoded to file p and frees it */
+Flush(w, p) struct Writer *w; char *p; {
+  int i, ok;
+  FILE *f;
+  fclose(w->f);
+  if ((ok = !!(f = fopen(p, "wb")))) {
+    fwrite(kSexpMagic, 1, 4, f);
+    PutVarint(f, w->ns);
+    for (i = 0; i < w->ns; ++i) {
+      PutVarint(f, M[w->sym[i]]);
+      fwrite(M + w->sym[i] + 1, 1, M[w->sym[i]], f);
+    }
+    fwrite(w->b, 1, w->n, f);
+    ok = !ferror(f) & !fclose(f);
+  }
+  if (!ok) perror(p);
+  free(w->b);
+  free(w->id);
+  free(w->sym);
+  free(w->k);
+  return ok;
+}
+
+/* interns the symbol table at r->p, returning 0 if it's malformed */
+Header(r) struct Reader *r; {
+  int c, n;
+  r->p += 4;
+  /* every name takes at least the byte of its length */
+  if ((c = GetVarint(r)) < 0 || c > r->e - r->p) return 0;
+  r->y = malloc((c + 1) * sizeof(int));
+  for (r->ny = 0; r->ny < c; ++r->ny) {
+    /* names are never empty nor hold a NUL, as the reader makes them */
+    if ((n = GetVarint(r)) <= 0 || n > r->e - r->p || memchr(r->p, 0, n))
+      return 0;
+    r->y[r->ny] = Intern(r->p, n);
+    r->p += n;
+  }
+  return 1;
+}
+
+/* stores v in the car or cdr slot e */
+Store(e, v) {
+  if (!(e & 1)) {
+    M[e >> 1] = v;
+  } else {
+#ifdef SOA
+    D[e >> 1] = v;
+#else
+    M[(e >> 1) + 1] = v;
+#endif
+  }
+}
+
+/* decodes r's next form into r->x, returning 0 if it's malformed */
+Decode(r) struct Reader *r; {
+  int b, c, e, i, n, v, x, *s, *t;
+  if ((c = GetVarint(r)) < 0) return 0;
+  if ((long)(kCell + 1) * c + 2 > cx - cf) Widen(r);
+  if ((long)(kCell + 1) * c + 2 > cx - cf) return 0;
+  b = x = cx -= c * kCell;
+  s = t = M + b;
+  *--s = 0; /* slot of the form itself */
+  while (s < t) {
+    e = *s++;
+    if ((v = GetVarint(r)) < 0) return 0;
+    if (v == 1) {
+      if (x == b + c * kCell) return 0;
+      *--s = 2 * x + 1;
+      *--s = 2 * x;
+      v = x;
+      x += kCell;
+    } else if (v & 1) {
+      n = v >> 1;
+      if (n <= 0 || n > (b + c * kCell - x) / kCell) return 0;
+      for (v = x, i = n; i--;) {
+        *--s = 2 * (x + i * kCell);
+        Store(2 * (x + i * kCell) + 1, i + 1 < n ? x + (i + 1) * kCell : 0);
+      }
+      x += n * kCell;
+    } else if (v && v <= 2 * r->ny) {
+      v = r->y[v / 2 - 1];
+    } else if (v) {
+      return 0;
+    }
+    if (e) {
+      Store(e, v);
+    } else {
+      r->x = v;
+    }
+  }
+  return x == b + c * kCell;
+}
+
+/* writes x to the binary file named by atom p, returning x */
+Dump(p, x) {
+  char b[PATH_MAX];
+  struct Writer w;
+  if (GetName(p, b)) {
+    Begin(&w);
+    Encode(&w, x);
+    Flush(&w, b);
+  }
+  return x;
+}
+
+/* returns the first form of the binary file named by atom p */
+Load(p) {
+  int fd;
+  char b[PATH_MAX];
+  unsigned char *m;
+  struct stat st;
+  struct Reader r = {0};
+  if (!GetName(p, b) || (fd = open(b, O_RDONLY)) == -1) {
+    perror(b);
+    return 0;
+  }
+  if (fstat(fd, &st) != -1 && st.st_size >= 4 &&
+      (m = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED) {
+    Feed(&r, m, st.st_size);
+    if (memcmp(r.p, kSexpMagic, 4) || !Header(&r) || !Decode(&r)) {
+      fprintf(stderr, "%s: bad binary input\n", b);
+      r.x = 0;
+    }
+    munmap(m, st.st_size);
+  }
+  free(r.y);
+  close(fd);
+  return r.x;
+}
+
+/* converts text file p to binary file q */
+EncodeFile(p, q) char *p, *q; {
+  struct Writer w;
+  if (!(fx = fopen(p, "r"))) {
+    perror(p);
+    return 1;
+  }
+  MapInput();
+  Begin(&w);
+  for (cx = px;;) {
+    if (Parse(&rx)) {
+      Encode(&w, rx.x);
+      cx = px;
+    } else if (!Refill()) {
+      if (Finish(&rx)) Encode(&w, rx.x);
+      break;
+    }
+  }
+  return !Flush(&w, q);
+}
+
+/* converts binary file p to text file q */
+DecodeFile(p, q) char *p, *q; {
+  if (!(fx = fopen(p, "r")) || !(ox = fopen(q, "w"))) {
+    perror(fx ? q : p);
+    return 1;
+  }
+  if (!MapInput() || !rx.y) {
+    fprintf(stderr, "%s: not binary\n", p);
+    return 1;
+  }
+  while (rx.p < rx.e) {
+    cx = px;
+    if (!Decode(&rx)) {
+      fprintf(stderr, "%s: bad binary input\n", p);
+      return 1;
+    }
+    Print(rx.x);
+    PrintNewLine();
+  }
+  PrintFlush();
+  return ferror(ox) | fclose(ox) == EOF;
+}
+
+/*───────────────────────────────────────────────────────────────────────────│─╗
+│ The LISP Challenge § Worker Threads                                      ─╬─│┼
+╚────────────────────────────────────────────────────────────────────────────│*/
+
+/*
+ * Files named on the command line are evaluated by jx worker threads.
+ * They share the symbol table, which Intern keeps consistent, and the
+ * persistent cells M[px..0) with ax, which nothing writes while they
+ * run. Below px each worker gets a private nursery of Nursery() ints,
+ * so Cons and the compaction in Eval need no locks, and its cf stops it
+ * at the bottom of its own. There are never so many workers that each
+ * would get less than kNursery ints. SAVE-IMAGE is ignored by
+ * workers, since persisting would write shared cells; build the
+ * environment beforehand with --image.
+ *
+ * Workers claim bx files at a time and Fetch them into buffers before
+ * evaluating any. Where io_uring is available that costs two system
+ * calls for the lot, one submitting every open and one every read and
+ * close, rather than three per file; otherwise plain calls are made. A
+ * file that fills its kBufSiz buffer is opened again and mapped. Output
+ * is kept in memory and printed in kBufSiz writes once all are done.
+ */
+
+/* returns the ints of M each of jx threads gets below px */
+Nursery() {
+  return (N / 2 + px) / jx & -2;
+}
+
+/* sets jx to n threads, or one per core, if they'd get kNursery each */
+Threads(n) {
+  if (!jx) jx = sysconf(_SC_NPROCESSORS_ONLN);
+  if (jx > n) jx = n;
+  if (jx > (N / 2 + px) / kNursery) jx = (N / 2 + px) / kNursery;
+  if (jx < 1) jx = 1;
+}
+
+struct Ring {
+  int fd, n; /* stores io_uring, or -1, and entries not yet submitted */
+  unsigned *sh, *st, *sm, *sa; /* stores submission head, tail, mask, array */
+  unsigned *ch, *ct, *cm; /* stores completion head, tail, mask */
+#if kUring
+  struct io_uring_sqe *sq;
+  struct io_uring_cqe *cq;
+#endif
+};
+
+#if kUring
+
+Setup(g) struct Ring *g; {
+  char *r;
+  long m, q;
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  g->n = 0;
+  if ((g->fd = syscall(__NR_io_uring_setup, kBatch * 2, &p)) == -1) return -1;
+  m = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  q = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (!(p.features & IORING_FEAT_SINGLE_MMAP) ||
+      (r = mmap(0, m > q ? m : q, PROT_READ | PROT_WRITE, MAP_SHARED,
+                g->fd, IORING_OFF_SQ_RING)) == MAP_FAILED ||
+      (g->sq = mmap(0, p.sq_entries * sizeof(struct io_uring_sqe),
+                    PROT_READ | PROT_WRITE, MAP_SHARED, g->fd,
+                    IORING_OFF_SQES)) == MAP_FAILED) {
+    close(g->fd);
+    return g->fd = -1;
+  }
+  g->sh = (unsigned *)(r + p.sq_off.head);
+  g->st = (unsigned *)(r + p.sq_off.tail);
+  g->sm = (unsigned *)(r + p.sq_off.ring_mask);
+  g->sa = (unsigned *)(r + p.sq_off.array);
+  g->ch = (unsigned *)(r + p.cq_off.head);
+  g->ct = (unsigned *)(r + p.cq_off.tail);
+  g->cm = (unsigned *)(r + p.cq_off.ring_mask);
+  g->cq = (struct io_uring_cqe *)(r + p.cq_off.cqes);
+  return g->fd;
+}
+
+/* returns a cleared submission entry for operation o on fd f */
+struct io_uring_sqe *Sqe(g, o, f) struct Ring *g; {
+  unsigned i;
+  struct io_uring_sqe *e;
+  i = (*g->st + g->n++) & *g->sm;
+  g->sa[i] = i;
+  e = g->sq + i;
+  memset(e, 0, sizeof(*e));
+  e->opcode = o;
+  e->fd = f;
+  return e;
+}
+
+/* submits pending entries and waits till w have completed */
+Enter(g, w) struct Ring *g; {
+  int r;
+  __atomic_store_n(g->st, *g->st + g->n, __ATOMIC_RELEASE);
+  do {
+    r = syscall(__NR_io_uring_enter, g->fd, g->n, w, IORING_ENTER_GETEVENTS,
+                0, 0);
+  } while (r == -1 && errno == EINTR);
+  g->n = 0;
+  return r;
+}
+
+/* takes the next completion, returning 0 if there are none */
+Cqe(g, d, r) struct Ring *g; int *d, *r; {
+  unsigned h;
+  struct io_uring_cqe *c;
+  h = *g->ch;
+  if (h == __atomic_load_n(g->ct, __ATOMIC_ACQUIRE)) return 0;
+  c = g->cq + (h & *g->cm);
+  *d = c->user_data;
+  *r = c->res;
+  __atomic_store_n(g->ch, h + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+/* reads files p[0,n) into buffers b with io_uring, or returns 0 */
+FetchRing(g, p, b, z, n) struct Ring *g; char **p, **b; int *z; {
+  int i, j, k, r;
+  struct io_uring_sqe *e;
+  for (i = 0; i < n; ++i) {
+    e = Sqe(g, IORING_OP_OPENAT, AT_FDCWD);
+    e->addr = (unsigned long)p[i];
+    e->open_flags = O_RDONLY;
+    e->user_data = i;
+  }
+  if (Enter(g, n) == -1) return 0;
+  while (Cqe(g, &i, &r)) z[i] = r;
+  if (z[0] == -EINVAL) return 0; /* no IORING_OP_OPENAT before linux 5.6 */
+  for (k = i = 0; i < n; ++i) {
+    if (z[i] < 0) continue;
+    e = Sqe(g, IORING_OP_READ, z[i]);
+    e->addr = (unsigned long)b[i];
+    e->len = kBufSiz;
+    e->flags = IOSQE_IO_HARDLINK; /* close after even a short read */
+    e->user_data = i;
+    e = Sqe(g, IORING_OP_CLOSE, z[i]);
+    e->user_data = -1;
+    k += 2;
+  }
+  if (Enter(g, k) == -1) return 0;
+  while (Cqe(g, &i, &r)) {
+    if (i != -1) z[i] = r;
+  }
+  __atomic_fetch_add(&lx, n, __ATOMIC_RELAXED);
+  return 1;
+}
+
+#else
+
+Setup(g) struct Ring *g; {
+  return g->fd = -1;
+}
+
+FetchRing() {
+  return 0;
+}
+
+#endif
+
+/* reads files p[0,n) into buffers b, storing their sizes or -errno in z */
+Fetch(g, p, b, z, n) struct Ring *g; char **p, **b; int *z; {
+  int i, f;
+  if (g->fd != -1) {
+    if (FetchRing(g, p, b, z, n)) return;
+    close(g->fd);
+    g->fd = -1;
+  }
+  for (i = 0; i < n; ++i) {
+    if ((f = open(p[i], O_RDONLY)) == -1 ||
+        (z[i] = read(f, b[i], kBufSiz)) == -1) {
+      z[i] = -errno;
+    }
+    if (f != -1) close(f);
+  }
+}
+
+/* evaluates input fed to rx from file s in the nursery below c */
+Evaluate(c, s) char *s; {
+  int e;
+  if (setjmp(cj)) {
+    fprintf(stderr, "%s: out of memory\n", s);
+  } else if (!setjmp(ux)) {
+    for (;;) {
+      cx = c;
+      e = Step();
+      Print(e);
+      PrintNewLine();
+    }
+  }
+  PrintChar('\n');
+  PrintFlush();
+}
+
+void *Worker(t) void *t; {
+  int i, j, n, c, z[kBatch];
+  char *b[kBatch];
+  struct Ring g;
+  c = px - (long)t * Nursery();
+  cf = c - Nursery();
+  for (j = 0; j < kBatch; ++j) b[j] = malloc(kBufSiz);
+  Setup(&g);
+  while ((i = __atomic_fetch_add(&nx, bx, __ATOMIC_RELAXED)) < fc) {
+    n = fc - i < bx ? fc - i : bx;
+    Fetch(&g, fv + i, b, z, n);
+    for (j = 0; j < n; ++j) {
+      fx = 0;
+      if (z[j] == kBufSiz && !(fx = fopen(fv[i + j], "r"))) z[j] = -errno;
+      if (z[j] < 0) {
+        fprintf(stderr, "%s: %s\n", fv[i + j], strerror(-z[j]));
+        continue;
+      }
+      ox = open_memstream(ov + i + j, on + i + j);
+      Reset(&rx);
+      rx.m = !!gx;
+      if (fx) {
+        wx = 0;
+        MapInput();
+      } else {
+        FeedAll(b[j], z[j]);
+      }
+      Evaluate(c, fv[i + j]);
+      fclose(ox);
+      if (fx) {
+        if (mx) munmap(rx.e - mx, mx);
+        fclose(fx);
+      }
+    }
+  }
+  if (g.fd != -1) close(g.fd);
+  for (j = 0; j < kBatch; ++j) free(b[j]);
+  return 0;
+}
+
+/* prints outputs ov[0,n) through a big buffer, so in few writes */
+Output(n) {
+  int i;
+  static char buf[kBufSiz];
+  setvbuf(stdout, buf, _IOFBF, sizeof(buf));
+  for (i = 0; i < n; ++i) fwrite(ov[i], 1, on[i], stdout);
+  return fflush(stdout);
+}
+
+RunWorkers() {
+  int i, rc;
+  pthread_t *th;
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  Threads(fc);
+  /* batch enough to save system calls but leave work to share */
+  bx = fc / (jx * 4);
+  if (bx > kBatch) bx = kBatch;
+  if (bx < 1) bx = 1;
+  th = calloc(jx, sizeof(*th));
+  ov = calloc(fc, sizeof(*ov));
+  on = calloc(fc, sizeof(*on));
+  for (i = 0; i < jx; ++i) pthread_create(th + i, 0, Worker, (void *)(long)i);
+  for (i = 0; i < jx; ++i) pthread_join(th[i], 0);
+  free(th);
+  rc = Output(fc) == EOF;
+  for (i = 0; i < fc; ++i) {
+    if (!ov[i]) rc = 1;
+    free(ov[i]);
+  }
+  if (vx) {
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    t1.tv_sec -= t0.tv_sec;
+    t1.tv_nsec -= t0.tv_nsec;
+    fprintf(stderr, "%d files in %.3f s, %.0f files/s, %d read with io_uring\n",
+            fc, t1.tv_sec + t1.tv_nsec * 1e-9,
+            fc / (t1.tv_sec + t1.tv_nsec * 1e-9), lx);
+  }
+  return rc;
+}
+
+/*
+ * With -p, batch input is parsed by a reader thread while the main one
+ * evaluates. Forms are read ahead into kSlots staging slots at the
+ * bottom of M, which the main thread's heap never grows into, and
+ * queued. A slot takes forms until it's a quarter full, then the reader
+ * moves on to the next once every form in it has been taken. Take
+ * copies a form up to the main thread's cx in one pass, adding the
+ * distance moved to each cell it holds. Each thread only wakes the
+ * other when a slot or the queue frees up or it must block, so a single
+ * core switches between them once per slot rather than once per form.
+ *
+ * The slots only take a sixteenth of M, so the main thread keeps most
+ * of the cells. A form that outgrows its slot is Widened: the reader
+ * waits till the main thread has taken every other form and is waiting
+ * for this one, then moves what it has read up to the main thread's cx
+ * and reads the rest there, so it's read in the main thread's heap as
+ * it would be without -p. One that runs out of memory even there, or
+ * of symbols, is dropped, and Take reports it like Recover does.
+ *
+ * Symbol collection and SAVE-IMAGE Pause the reader between forms, and
+ * forms still queued are kept and renumbered. Since those keep their
+ * symbols alive, once collection is Due or symbols fill half their space
+ * the reader is Held until the main thread has drained the queue and
+ * collected.
+ */
+
+/* returns top of staging slot i, the arena being N / 16 ints of M */
+Stage(i) {
+  return -N / 2 + (i + 1) * (N / 16 / kSlots & -2);
+}
+
+/* returns whether the reader should move on from staging slot i */
+Filled(i) {
+  return cx < Stage(i) - (N / 16 / kSlots / 4);
+}
+
+Wake() {
+  pthread_mutex_lock(&qm);
+  pthread_cond_broadcast(&qc);
+  pthread_mutex_unlock(&qm);
+}
+
+/* returns whether reading ahead should wait for symbol collection */
+Crowded() {
+  return Due() || Symbols() > N / 4;
+}
+
+/* returns whether the reader must wait before reading into slot i */
+Held(i) {
+  if (qg || qw - qr == kQueue) return 1;
+  if (Filled(i) && qr < qn[(i + 1) % kSlots]) return 1;
+  return Crowded() && !qt;
+}
+
+/* moves the form r is reading ahead up to the main thread's heap */
+Widen(r) struct Reader *r; {
+  int i, k, v;
+  if (r != qy || qo) return;
+  pthread_mutex_lock(&qm);
+  qo = 1;
+  pthread_cond_broadcast(&qc);
+  while (!qt || qr < qw) pthread_cond_wait(&qc, &qm);
+  pthread_mutex_unlock(&qm);
+  k = qz - qb;
+  if (cx + k < Stage(kSlots - 1)) return; /* it won't fit there either */
+  for (i = qb; i-- > cx;) {
+    v = M[i];
+    M[i + k] = v < 0 ? v + k : v;
+#ifdef SOA
+    v = D[i];
+    D[i + k] = v < 0 ? v + k : v;
+#endif
+  }
+  for (i = 0; i < r->nv; ++i) {
+    if (r->v[i] < 0) r->v[i] += k;
+  }
+  for (i = 2; i < r->ng; i += 3) {
+    if (r->g[i] < 0) r->g[i] += k;
+  }
+  cx += k;
+  qb = qz;
+  cf = Stage(kSlots - 1);
+}
+
+void *Reader(f) void *f; {
+  int i, j, b, d, x;
+  fx = f;
+  qy = &rx;
+  rx.m = !!gx;
+  if (setjmp(cj)) {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+  OpenInput();
+  cx = Stage(i = 0);
+  for (;;) {
+    j = (i + 1) % kSlots;
+    pthread_mutex_lock(&qm);
+    while (Held(i)) {
+      qp = 1;
+      pthread_cond_broadcast(&qc);
+      pthread_cond_wait(&qc, &qm);
+      qp = 0;
+    }
+    pthread_mutex_unlock(&qm);
+    if (Filled(i)) cx = Stage(i = j);
+    cf = Stage(i - 1);
+    qb = b = cx;
+    d = 0;
+    if (setjmp(ux)) break;
+    if (setjmp(cj)) {
+      Abandon();
+      d = 1;
+    } else {
+      x = Read();
+    }
+    pthread_mutex_lock(&qm);
+    qv[qw % kQueue] = d ? 0 : x;
+    ql[qw % kQueue] = d ? qb : cx;
+    qh[qw % kQueue] = qb;
+    qd[qw % kQueue] = d;
+    qn[i] = ++qw;
+    qo = 0;
+    if (qt && Crowded()) {
+      qt = 0; /* hand it over now so symbols can be collected */
+      pthread_cond_broadcast(&qc);
+    }
+    pthread_mutex_unlock(&qm);
+    if (d || qb != b) cx = b; /* what's left in the slot is garbage */
+  }
+  pthread_mutex_lock(&qm);
+  qe = 1;
+  pthread_cond_broadcast(&qc);
+  pthread_mutex_unlock(&qm);
+  return 0;
+}
+
+ReadAhead() {
+  pthread_t th;
+  pthread_create(&th, 0, Reader, fx);
+  pthread_detach(th);
+}
+
+/* waits till the reader is between forms or Widening one, and holds it */
+Pause() {
+  if (!qx) return;
+  pthread_mutex_lock(&qm);
+  qg = 1;
+  while (!qp && !qe && !qo) pthread_cond_wait(&qc, &qm);
+  pthread_mutex_unlock(&qm);
+}
+
+Resume() {
+  if (!qx) return;
+  pthread_mutex_lock(&qm);
+  qg = 0;
+  pthread_cond_broadcast(&qc);
+  pthread_mutex_unlock(&qm);
+}
+
+Take() {
+  int b, d, i, j, k, v, x;
+  pthread_mutex_lock(&qm);
+  qz = cx;
+  while (qr == qw && !qe) {
+    qt = 1;
+    pthread_cond_broadcast(&qc);
+    pthread_cond_wait(&qc, &qm);
+    qt = 0;
+  }
+  pthread_mutex_unlock(&qm);
+  if (qr == qw) EndOfInput();
+  i = qr % kQueue;
+  k = cx - qh[i];
+  if ((b = ql[i] + k) >= cf) {
+    for (j = ql[i]; j < qh[i]; ++j) {
+      v = M[j];
+      M[j + k] = v < 0 ? v + k : v;
+#ifdef SOA
+      v = D[j];
+      D[j + k] = v < 0 ? v + k : v;
+#endif
+    }
+    cx = b;
+  }
+  x = qv[i];
+  d = qd[i];
+  pthread_mutex_lock(&qm);
+  if (++qr == qw - kQueue / 2) pthread_cond_broadcast(&qc);
+  for (j = 0; j < kSlots; ++j) {
+    if (qr == qn[j]) pthread_cond_broadcast(&qc);
+  }
+  pthread_mutex_unlock(&qm);
+  if (b < cf || d) Exhausted(); /* it's been taken, so it's dropped */
+  return x < 0 ? x + k : x;
+}
+
+/*───────────────────────────────────────────────────────────────────────────│─╗
+│ The LISP Challenge § Writing Behind                                      ─╬─│┼
+╚────────────────────────────────────────────────────────────────────────────│*/
+
+/*
+ * With -w the main thread's output goes through a ring of kRing bytes
+ * to a writer thread, so evaluation goes on while a slow pipe or
+ * terminal takes its time. The main thread is the only one to put
+ * bytes in and the writer the only one to take them out, so each just
+ * publishes its count, wh or wt, and the lock is only taken by a side
+ * that has to wait, for room or for bytes, or that must wake the other.
+ * Output is drained before READ or a prompt reads input, so what was
+ * printed is seen first, and again at exit so none of it is lost.
+ */
+
+/* puts n bytes at p in the ring, waiting for room if it's full */
+Put(p, n) char *p; {
+  int k;
+  unsigned long h;
+  for (h = wh; n; n -= k, p += k) {
+    if (!(k = kRing - (h - __atomic_load_n(&wt, __ATOMIC_SEQ_CST)))) {
+      pthread_mutex_lock(&wm);
+      __atomic_store_n(&wa, 1, __ATOMIC_SEQ_CST);
+      while (h - __atomic_load_n(&wt, __ATOMIC_SEQ_CST) == kRing)
+        pthread_cond_wait(&wc, &wm);
+      wa = 0;
+      pthread_mutex_unlock(&wm);
+      k = 0;
+      continue;
+    }
+    if (k > n) k = n;
+    if (k > kRing - h % kRing) k = kRing - h % kRing;
+    memcpy(wr + h % kRing, p, k);
+    __atomic_store_n(&wh, h += k, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&wb, __ATOMIC_SEQ_CST)) {
+      pthread_mutex_lock(&wm);
+      pthread_cond_signal(&wc);
+      pthread_mutex_unlock(&wm);
+    }
+  }
+}
+
+void *Writer(f) void *f; {
+  long k;
+  unsigned long h, t;
+  for (t = wt;;) {
+    if ((h = __atomic_load_n(&wh, __ATOMIC_SEQ_CST)) == t) {
+      pthread_mutex_lock(&wm);
+      __atomic_store_n(&wb, 1, __ATOMIC_SEQ_CST);
+      while ((h = __atomic_load_n(&wh, __ATOMIC_SEQ_CST)) == t)
+        pthread_cond_wait(&wc, &wm);
+      wb = 0;
+      pthread_mutex_unlock(&wm);
+    }
+    if (h - t > kRing - t % kRing) h = t + kRing - t % kRing;
+    if ((k = write(1, wr + t % kRing, h - t)) == -1 && errno == EINTR) continue;
+    if (k <= 0) k = h - t; /* output is gone, so there's no one to tell */
+    __atomic_store_n(&wt, t += k, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&wa, __ATOMIC_SEQ_CST)) {
+      pthread_mutex_lock(&wm);
+      pthread_cond_signal(&wc);
+      pthread_mutex_unlock(&wm);
+    }
+  }
+}
+
+/* waits till the writer thread has written everything put in the ring */
+Sync() {
+  if (!wr) return;
+  pthread_mutex_lock(&wm);
+  __atomic_store_n(&wa, 1, __ATOMIC_SEQ_CST);
+  while (__atomic_load_n(&wt, __ATOMIC_SEQ_CST) != wh)
+    pthread_cond_wait(&wc, &wm);
+  wa = 0;
+  pthread_mutex_unlock(&wm);
+}
+
+/* flushes and drains output at exit */
+void Drain() {
+  PrintFlush();
+  Sync();
+}
+
+WriteBehind() {
+  pthread_t th;
+  fflush(stdout);
+  wr = malloc(kRing);
+  pthread_create(&th, 0, Writer, 0);
+  pthread_detach(th);
+  atexit(Drain);
+}
+
+/*───────────────────────────────────────────────────────────────────────────│─╗
+│ The LISP Challenge § Serving                                             ─╬─│┼
+╚────────────────────────────────────────────────────────────────────────────│*/
+
+/*
+ * --serve SOCKET answers forms sent over a Unix domain socket, so other
+ * programs can use the interpreter without driving a REPL. Each line a
+ * client sends is a request, read on its own, and for each form on it
+ * the client gets back a line with the value as printed, a tab, and the
+ * microseconds spent evaluating it. A line that ends partway through a
+ * form, or whose READ runs off its end, is answered with an error and
+ * forgotten, so it can't swallow the lines after it. A pool of -j
+ * threads take turns accepting connections and serve one at a time,
+ * each with its own reader, output and nursery like a file worker, so
+ * clients are evaluated in parallel and share the image.
+ *
+ * Symbols are collected between requests. A thread that finds them Due
+ * holds off new requests till the others have answered theirs, so it
+ * collects with every other thread idle, as GcSymbols needs.
+ *
+ * With --prefork PROCESSES they're processes instead, forked once the
+ * image is loaded, so they share its pages copy-on-write and start in
+ * no time. One that crashes or, with --requests N, has served N forms
+ * when a connection closes, is replaced by a fresh fork, which drops
+ * whatever symbols its requests interned.
+ */
+
+/* waits till symbols aren't being collected, collects them if they're
+   due, then counts this thread among those answering a request */
+Admit() {
+  pthread_mutex_lock(&sm);
+  while (sg) pthread_cond_wait(&sc, &sm);
+  if (Due()) {
+    sg = 1;
+    while (sb) pthread_cond_wait(&sc, &sm);
+    sx = GcSymbols();
+    sg = 0;
+    pthread_cond_broadcast(&sc);
+  }
+  ++sb;
+  pthread_mutex_unlock(&sm);
+}
+
+Dismiss() {
+  pthread_mutex_lock(&sm);
+  if (!--sb && sg) pthread_cond_broadcast(&sc);
+  pthread_mutex_unlock(&sm);
+}
+
+/* answers with s in place of a value */
+Reply(s) char *s; {
+  while (*s) PrintChar(*s++);
+  PrintNewLine();
+}
+
+/* answers each form on the line fed to rx */
+Session(c) {
+  int e, u;
+  struct timespec t0, t1;
+  if (setjmp(ux)) {
+    Reply("? incomplete form"); /* READ ran off the end of the line */
+    return;
+  }
+  if (setjmp(cj)) {
+    Reply("? out of memory");
+    return;
+  }
+  for (;;) {
+    cx = c;
+    if (!Parse(&rx) && !Finish(&rx)) break;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    e = Run(rx.x);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    u = (t1.tv_sec - t0.tv_sec) * 1000000 + (t1.tv_nsec - t0.tv_nsec) / 1000;
+    Print(e);
+    PrintChar('\t');
+    PrintInt(u);
+    PrintNewLine();
+    ++sn;
+  }
+  if (rx.d > rx.m) Reply("? incomplete form");
+}
+
+void *Server(t) void *t; {
+  int c, fd;
+  long n;
+  size_t z;
+  char *l;
+  c = px - (long)t * Nursery();
+  cf = c - Nursery();
+  wx = 1; /* a request is only what's on its line */
+  for (l = 0, z = 0;;) {
+    if ((fd = accept(sv, 0, 0)) == -1) {
+      if (errno == EBADF || errno == EINVAL) return 0;
+      continue;
+    }
+    fx = fdopen(fd, "r");
+    ox = fdopen(dup(fd), "w");
+    ot = 1; /* so every response is sent once it's printed */
+    oz = 0;
+    while ((n = getline(&l, &z, fx)) > 0) {
+      Admit();
+      Reset(&rx);
+      rx.m = !!gx;
+      Feed(&rx, l, n);
+      Session(c);
+      Dismiss();
+    }
+    fclose(ox);
+    fclose(fx);
+    if (sf && sr && sn >= sr) _exit(0);
+  }
+}
+
+/* keeps sf server processes running */
+Prefork() {
+  int n;
+  pid_t pid, pp;
+  jx = 1;
+  pp = getpid();
+  for (n = 0;;) {
+    if (n < sf) {
+      if ((pid = fork()) == -1) {
+        perror("fork");
+        return 1;
+      }
+      if (!pid) {
+#ifdef __linux__
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+        if (getppid() != pp) _exit(0); /* server went away while forking */
+        Server(0);
+      }
+      ++n;
+    } else if (wait(0) != -1) {
+      --n;
+    } else if (errno != EINTR) {
+      perror("wait");
+      return 1;
+    }
+  }
+}
+
+Serve(p) char *p; {
+  long i;
+  pthread_t th;
+  struct stat st;
+  struct sockaddr_un a;
+  memset(&a, 0, sizeof(a));
+  a.sun_family = AF_UNIX;
+  if (strlen(p) >= sizeof(a.sun_path)) {
+    fprintf(stderr, "%s: socket path too long\n", p);
+    return 1;
+  }
+  strcpy(a.sun_path, p);
+  /* a socket left over from an earlier server is in the way */
+  if (!stat(p, &st) && S_ISSOCK(st.st_mode)) unlink(p);
+  if ((sv = socket(AF_UNIX, SOCK_STREAM, 0)) == -1 ||
+      bind(sv, (struct sockaddr *)&a, sizeof(a)) == -1 ||
+      listen(sv, SOMAXCONN) == -1) {
+    perror(p);
+    return 1;
+  }
+  signal(SIGPIPE, SIG_IGN); /* a client leaving mustn't kill the server */
+  if (sf) return Prefork();
+  Threads(INT_MAX);
+  for (i = 1; i < jx; ++i) {
+    pthread_create(&th, 0, Server, (void *)i);
+    pthread_detach(th);
+  }
+  Server(0);
+  return 1;
+}
+
+/*───────────────────────────────────────────────────────────────────────────│─╗
+│ The LISP Challenge § User Interface                                      ─╬─│┼
+╚────────────────────────────────────────────────────────────────────────────│*/
+
+/* parses and persists the --map function p */
+SetMap(p) char *p; {
+  int e;
+  cx = px;
+  Feed(&rx, p, strlen(p));
+  if (!Parse(&rx) && !Finish(&rx)) {
+    fprintf(stderr, "%s: incomplete --map function\n", p);
+    exit(1);
+  }
+  Reset(&rx);
+  e = Persist(Cons(rx.x, ax));
+  gx = Car(e);
+  ax = Cdr(e);
+  rx.m = 1;
+}
+
+main(argc, argv) char *argv[]; {
+  int i, e, w = 0;
+  char *s, *m = 0, *v = 0;
   setlocale(LC_ALL, "");
+  ox = stdout;
+  ot = isatty(1);
+  atexit(PrintFlush);
+  cf = -(int)(N / 2);
+  if (setjmp(cj)) {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
   bestlineSetXlatCallback(bestlineUppercase);
-  for(i = 0; i < sizeof(S); ++i) M[i] = S[i];
+  ex = kT;
+  for (s = S; s < S + sizeof(S); s += strlen(s) + 1) Intern(s, strlen(s));
+  for (i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--image") && i + 1 < argc) {
+      LoadImage(argv[++i]);
+    } else if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+      if (!(fx = fopen(argv[++i], "r"))) {
+        perror(argv[i]);
+        exit(1);
+      }
+    } else if (!strcmp(argv[i], "--encode") && i + 2 < argc) {
+      exit(EncodeFile(argv[i + 1], argv[i + 2]));
+    } else if (!strcmp(argv[i], "--decode") && i + 2 < argc) {
+      exit(DecodeFile(argv[i + 1], argv[i + 2]));
+    } else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+      jx = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-p")) {
+      qx = 1;
+    } else if (!strcmp(argv[i], "-w")) {
+      w = 1;
+    } else if (!strcmp(argv[i], "--stats")) {
+      vx = 1;
+    } else if (!strcmp(argv[i], "--shared")) {
+      zx = 1;
+    } else if (!strcmp(argv[i], "--print-length") && i + 1 < argc) {
+      hl = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--print-depth") && i + 1 < argc) {
+      hd = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--print-bytes") && i + 1 < argc) {
+      hb = atol(argv[++i]);
+    } else if (!strcmp(argv[i], "--map") && i + 1 < argc) {
+      m = argv[++i];
+    } else if (!strcmp(argv[i], "--serve") && i + 1 < argc) {
+      v = argv[++i];
+    } else if (!strcmp(argv[i], "--prefork") && i + 1 < argc) {
+      sf = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--requests") && i + 1 < argc) {
+      sr = atol(argv[++i]);
+    } else if (argv[i][0] != '-') {
+      break;
+    } else {
+      fprintf(stderr,
+              "usage: %s [--image FILE] [--map FUNCTION] [-f FILE] [-p] [-w] "
+              "[-j THREADS]\n"
+              "       %*s [--stats] [--shared] [--print-length N] "
+              "[--print-depth N]\n"
+              "       %*s [--print-bytes N] [FILE...]\n"
+              "       %s [--image FILE] [--map FUNCTION] "
+              "[-j THREADS | --prefork PROCESSES]\n"
+              "       %*s [--requests N] --serve SOCKET\n"
+              "       %s --encode TEXT BINARY\n"
+              "       %s --decode BINARY TEXT\n",
+              argv[0], (int)strlen(argv[0]), "", (int)strlen(argv[0]), "",
+              argv[0], (int)strlen(argv[0]), "", argv[0], argv[0]);
+      exit(1);
+    }
+  }
+  if (m) SetMap(m);
+  if (v) exit(Serve(v));
+  if (i < argc) {
+    fv = argv + i;
+    fc = argc - i;
+    exit(RunWorkers());
+  }
+  if (!fx && !isatty(0)) fx = stdin;
+  /* reading ahead needs its staging slots clear of the image's cells */
+  if (!fx || px < Stage(kSlots - 1)) qx = 0;
+  if (w) WriteBehind();
+  if (qx) {
+    cf = Stage(kSlots - 1);
+    ReadAhead();
+  } else if (fx) {
+    OpenInput();
+  }
+  if (setjmp(ux)) {
+    PrintChar('\n');
+    exit(0);
+  }
+  if (setjmp(cj)) Recover();
   for (;;) {
-    cx = 0;
-    Print(Eval(Read(), 0));
+    if (Due() && qr == qw) {
+      Pause();
+      if (!qo) sx = GcSymbols(); /* not while a form is half read */
+      Resume();
+    }
+    cx = px;
+    ix = 0;
+    e = Step();
+    Print(e);
     PrintNewLine();
+    if (ix) {
+      Pause();
+      e = Persist(Cons(e, gx));
+      ax = Car(e);
+      gx = Cdr(e);
+      SaveImage(ix);
+      Resume();
+    }
   }
 }
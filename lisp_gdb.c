@@ -47,7 +47,7 @@ typedef struct lisp_object {
   object_type_t type;    /* Type tag for GDB visibility */
   bool marked;           /* GC mark bit */
   union {
-    char *symbol;        /* For TYPE_ATOM: pointer to interned string */
+    char *symbol;        /* For TYPE_ATOM: name in the string arena */
     struct {
       struct lisp_object *car;
       struct lisp_object *cdr;
@@ -55,31 +55,23 @@ typedef struct lisp_object {
   } data;
 } lisp_object_t;
 
-/* Constants for builtin symbols (as string offsets) */
-#define BUILTIN_NIL   0
-#define BUILTIN_T     4
-#define BUILTIN_QUOTE 6
-#define BUILTIN_COND  12
-#define BUILTIN_READ  17
-#define BUILTIN_PRINT 22
-#define BUILTIN_ATOM  28
-#define BUILTIN_CAR   33
-#define BUILTIN_CDR   37
-#define BUILTIN_CONS  41
-#define BUILTIN_EQ    46
-
 /* Initial builtin symbols string */
 #define BUILTIN_SYMBOLS "NIL\0T\0QUOTE\0COND\0READ\0PRINT\0ATOM\0CAR\0CDR\0CONS\0EQ"
 
 /* Memory configuration */
 #define HEAP_SIZE 50000
 #define SYMBOL_TABLE_SIZE 10000
+#define SYMBOL_INDEX_SIZE 16384                 /* Power of two, > 1.5x table */
+#define STRING_ARENA_SIZE 262144
 
 /* Global state */
 static lisp_object_t heap[HEAP_SIZE];           /* Object heap */
 static int heap_ptr = 0;                        /* Next free slot in heap */
-static char *symbol_table[SYMBOL_TABLE_SIZE];   /* Interned strings */
+static lisp_object_t symbol_table[SYMBOL_TABLE_SIZE]; /* One atom per symbol */
 static int symbol_count = 0;                    /* Number of interned symbols */
+static lisp_object_t *symbol_index[SYMBOL_INDEX_SIZE]; /* Hash of names */
+static char string_arena[STRING_ARENA_SIZE];    /* Symbol names */
+static int string_arena_used = 0;               /* Bytes of arena in use */
 static char symbol_buffer[256];                 /* Buffer for reading symbols */
 static int lookahead_char = 0;                  /* Lookahead character for parser */
 
@@ -95,54 +87,79 @@ static lisp_object_t *car_obj;
 static lisp_object_t *cdr_obj;
 static lisp_object_t *cons_obj;
 static lisp_object_t *eq_obj;
+static lisp_object_t *lambda_obj;
+
+/* Builtin symbol objects, in BUILTIN_SYMBOLS order */
+static lisp_object_t **const builtin_objs[] = {
+  &nil_obj, &t_obj, &quote_obj, &cond_obj, &read_obj, &print_obj,
+  &atom_obj, &car_obj, &cdr_obj, &cons_obj, &eq_obj,
+};
 
 /*───────────────────────────────────────────────────────────────────────────│─╗
 │ String Interning                                                          ─╬─│┼
 ╚────────────────────────────────────────────────────────────────────────────│*/
 
-/* Intern a string: return existing pointer if already interned, else add it */
-static char *intern_string(const char *str) {
-  /* Search for existing string */
-  for (int i = 0; i < symbol_count; i++) {
-    if (strcmp(symbol_table[i], str) == 0) {
-      return symbol_table[i];
+/* FNV-1a hash of a symbol name */
+static unsigned hash_string(const char *str) {
+  unsigned h = 2166136261u;
+  while (*str) {
+    h = (h ^ (unsigned char)*str++) * 16777619u;
+  }
+  return h;
+}
+
+/* Intern a symbol: return its unique atom object, creating it if new.
+   Atoms live in symbol_table rather than the heap, so the same name
+   always yields the same pointer and never moves. */
+static lisp_object_t *intern(const char *str) {
+  unsigned i = hash_string(str) & (SYMBOL_INDEX_SIZE - 1);
+
+  /* Probe for an existing atom */
+  for (; symbol_index[i]; i = (i + 1) & (SYMBOL_INDEX_SIZE - 1)) {
+    if (strcmp(symbol_index[i]->data.symbol, str) == 0) {
+      return symbol_index[i];
     }
   }
 
-  /* Not found, add new string */
+  /* Not found, add new atom */
+  int len = strlen(str) + 1;
   if (symbol_count >= SYMBOL_TABLE_SIZE) {
     fprintf(stderr, "Symbol table overflow\n");
     exit(1);
   }
-
-  char *new_str = strdup(str);
-  if (!new_str) {
-    fprintf(stderr, "Out of memory\n");
+  if (string_arena_used + len > STRING_ARENA_SIZE) {
+    fprintf(stderr, "String arena overflow\n");
     exit(1);
   }
 
-  symbol_table[symbol_count] = new_str;
-  return symbol_table[symbol_count++];
+  lisp_object_t *obj = &symbol_table[symbol_count++];
+  obj->type = TYPE_ATOM;
+  obj->marked = false;
+  obj->data.symbol = memcpy(string_arena + string_arena_used, str, len);
+  string_arena_used += len;
+  symbol_index[i] = obj;
+  return obj;
 }
 
 /*───────────────────────────────────────────────────────────────────────────│─╗
-│ Object Construction                                                       ─╬─│┼
+│ Heap                                                                      ─╬─│┼
 ╚────────────────────────────────────────────────────────────────────────────│*/
 
-/* Create atom from interned string pointer */
-static lisp_object_t *make_atom(char *symbol) {
-  if (heap_ptr >= HEAP_SIZE) {
-    fprintf(stderr, "Heap overflow at %d objects\n", heap_ptr);
-    exit(1);
-  }
+/*
+ * Atoms are not in the heap, so nothing in it outlives a form. It holds
+ * everything allocated while reading, evaluating and printing one
+ * top-level form, and is emptied once the form is done.
+ */
 
-  lisp_object_t *obj = &heap[heap_ptr++];
-  obj->type = TYPE_ATOM;
-  obj->marked = false;
-  obj->data.symbol = symbol;
-  return obj;
+/* Free everything the last form allocated, in O(1) */
+static void release_heap(void) {
+  heap_ptr = 0;
 }
 
+/*───────────────────────────────────────────────────────────────────────────│─╗
+│ Object Construction                                                       ─╬─│┼
+╚────────────────────────────────────────────────────────────────────────────│*/
+
 /* Create cons cell */
 static lisp_object_t *make_cons(lisp_object_t *car, lisp_object_t *cdr) {
   if (heap_ptr >= HEAP_SIZE) {
@@ -195,11 +212,7 @@ static bool is_atom(lisp_object_t *obj) {
 }
 
 static bool eq(lisp_object_t *a, lisp_object_t *b) {
-  /* For atoms, compare by pointer equality (since strings are interned) */
-  if (a->type == TYPE_ATOM && b->type == TYPE_ATOM) {
-    return a->data.symbol == b->data.symbol;
-  }
-  /* NIL == NIL by pointer equality too */
+  /* Every symbol, NIL included, has exactly one atom object */
   return a == b;
 }
 
@@ -261,44 +274,14 @@ static void compact_heap(void) {
     }
   }
 
-  /* Copy back to main heap */
+  /* Copy back to main heap; atoms, builtins included, never move */
   memcpy(heap, temp_heap, new_ptr * sizeof(lisp_object_t));
 
-  /* Update builtin pointers */
-  for (int i = 0; i < new_ptr; i++) {
-    if (heap[i].type == TYPE_ATOM) {
-      if (strcmp(heap[i].data.symbol, "NIL") == 0) nil_obj = &heap[i];
-      else if (strcmp(heap[i].data.symbol, "T") == 0) t_obj = &heap[i];
-      else if (strcmp(heap[i].data.symbol, "QUOTE") == 0) quote_obj = &heap[i];
-      else if (strcmp(heap[i].data.symbol, "COND") == 0) cond_obj = &heap[i];
-      else if (strcmp(heap[i].data.symbol, "READ") == 0) read_obj = &heap[i];
-      else if (strcmp(heap[i].data.symbol, "PRINT") == 0) print_obj = &heap[i];
-      else if (strcmp(heap[i].data.symbol, "ATOM") == 0) atom_obj = &heap[i];
-      else if (strcmp(heap[i].data.symbol, "CAR") == 0) car_obj = &heap[i];
-      else if (strcmp(heap[i].data.symbol, "CDR") == 0) cdr_obj = &heap[i];
-      else if (strcmp(heap[i].data.symbol, "CONS") == 0) cons_obj = &heap[i];
-      else if (strcmp(heap[i].data.symbol, "EQ") == 0) eq_obj = &heap[i];
-    }
-  }
-
   heap_ptr = new_ptr;
 }
 
 /* Run garbage collection, marking roots and sweeping */
 static void gc(lisp_object_t *root) {
-  /* Mark builtin symbols */
-  mark_object(nil_obj);
-  mark_object(t_obj);
-  mark_object(quote_obj);
-  mark_object(cond_obj);
-  mark_object(read_obj);
-  mark_object(print_obj);
-  mark_object(atom_obj);
-  mark_object(car_obj);
-  mark_object(cdr_obj);
-  mark_object(cons_obj);
-  mark_object(eq_obj);
-
   /* Mark root */
   mark_object(root);
 
@@ -370,14 +353,7 @@ static lisp_object_t *get_list(void) {
 
 static lisp_object_t *get_object(int c) {
   if (c == '(') return get_list();
-  /* Intern the symbol */
-  char *sym = intern_string(symbol_buffer);
-  /* Special case: NIL returns the singleton nil object */
-  if (strcmp(sym, "NIL") == 0) {
-    return nil_obj;
-  }
-  /* Create atom for other symbols */
-  return make_atom(sym);
+  return intern(symbol_buffer);
 }
 
 static lisp_object_t *read_expr(void) {
@@ -487,8 +463,7 @@ static lisp_object_t *apply(lisp_object_t *fn, lisp_object_t *args, lisp_object_
   }
 
   /* Lambda: (LAMBDA params body) */
-  if (fn->type == TYPE_CONS && car(fn)->type == TYPE_ATOM &&
-      strcmp(car(fn)->data.symbol, "LAMBDA") == 0) {
+  if (fn->type == TYPE_CONS && car(fn) == lambda_obj) {
     lisp_object_t *params = car(cdr(fn));
     lisp_object_t *body = car(cdr(cdr(fn)));
     lisp_object_t *new_env = pairlis(params, args, env);
@@ -568,43 +543,16 @@ static lisp_object_t *eval(lisp_object_t *expr, lisp_object_t *env) {
 ╚────────────────────────────────────────────────────────────────────────────│*/
 
 static void init_builtins(void) {
-  /* Create special NIL object first */
-  if (heap_ptr >= HEAP_SIZE) {
-    fprintf(stderr, "Heap overflow\n");
-    exit(1);
+  /* Intern each builtin symbol, keeping a pointer to its atom */
+  const char *ptr = BUILTIN_SYMBOLS;
+  for (size_t i = 0; i < sizeof(builtin_objs) / sizeof(*builtin_objs); i++) {
+    *builtin_objs[i] = intern(ptr);
+    ptr += strlen(ptr) + 1;
   }
-  nil_obj = &heap[heap_ptr++];
+
+  /* NIL is the empty list rather than an ordinary atom */
   nil_obj->type = TYPE_NIL;
-  nil_obj->marked = false;
-
-  /* Intern NIL symbol for string comparison */
-  intern_string("NIL");
-
-  /* Parse remaining builtin symbols string */
-  const char *symbols = BUILTIN_SYMBOLS;
-  const char *ptr = symbols + 4;  /* Skip "NIL\0" */
-
-  while (*ptr) {
-    int len = strlen(ptr);
-    char *interned = intern_string(ptr);
-
-    /* Create atom for this builtin */
-    lisp_object_t *obj = make_atom(interned);
-
-    /* Save pointer to builtin objects */
-    if (strcmp(interned, "T") == 0) t_obj = obj;
-    else if (strcmp(interned, "QUOTE") == 0) quote_obj = obj;
-    else if (strcmp(interned, "COND") == 0) cond_obj = obj;
-    else if (strcmp(interned, "READ") == 0) read_obj = obj;
-    else if (strcmp(interned, "PRINT") == 0) print_obj = obj;
-    else if (strcmp(interned, "ATOM") == 0) atom_obj = obj;
-    else if (strcmp(interned, "CAR") == 0) car_obj = obj;
-    else if (strcmp(interned, "CDR") == 0) cdr_obj = obj;
-    else if (strcmp(interned, "CONS") == 0) cons_obj = obj;
-    else if (strcmp(interned, "EQ") == 0) eq_obj = obj;
-
-    ptr += len + 1;
-  }
+  lambda_obj = intern("LAMBDA");
 }
 
 int main(void) {
@@ -622,10 +570,8 @@ int main(void) {
     print_char('\n');
     fflush(stdout);
 
-    /* GC disabled for now - heap is large enough */
-    /* if (heap_ptr > HEAP_SIZE * 0.8) {
-      gc(result);
-    } */
+    /* Nothing from this form is reachable any more */
+    release_heap();
   }
 
   return 0;
@@ -26,7 +26,7 @@
 #include <locale.h>
 #include <limits.h>
 #include <stdbool.h>
-#include <wchar.h>
+#include <unistd.h>
 
 /*───────────────────────────────────────────────────────────────────────────│─╗
 │ GDB-Friendly LISP Machine with Explicit Data Structures                  ─╬─│┼
@@ -83,6 +83,9 @@ static char *symbol_table[SYMBOL_TABLE_SIZE];   /* Interned strings */
 static int symbol_count = 0;                    /* Number of interned symbols */
 static char symbol_buffer[256];                 /* Buffer for reading symbols */
 static int lookahead_char = 0;                  /* Lookahead character for parser */
+static char output_buffer[65536];               /* Output not yet written */
+static size_t output_length = 0;                /* Bytes in output_buffer */
+static bool output_is_tty = false;              /* Flush at each newline */
 
 /* Tracing state */
 static bool trace = false;                      /* Trace flag */
@@ -318,8 +321,45 @@ static void gc(lisp_object_t *root) {
 │ I/O and Parsing                                                           ─╬─│┼
 ╚────────────────────────────────────────────────────────────────────────────│*/
 
+static void flush_output(void) {
+  fwrite(output_buffer, 1, output_length, stdout);
+  output_length = 0;
+  fflush(stdout);
+}
+
+/* Buffer c as UTF-8, which only the dot of dotted pairs needs more than
+   one byte for, flushing at newlines when stdout is a terminal */
 static void print_char(int c) {
-  fputwc(c, stdout);
+  if (output_length + 3 > sizeof(output_buffer)) flush_output();
+  if (c < 0x80) {
+    output_buffer[output_length++] = c;
+  } else if (c < 0x800) {
+    output_buffer[output_length++] = 0xc0 | c >> 6;
+    output_buffer[output_length++] = 0x80 | (c & 0x3f);
+  } else {
+    output_buffer[output_length++] = 0xe0 | c >> 12;
+    output_buffer[output_length++] = 0x80 | (c >> 6 & 0x3f);
+    output_buffer[output_length++] = 0x80 | (c & 0x3f);
+  }
+  if (c == '\n' && output_is_tty) flush_output();
+}
+
+/* Buffer n bytes of s as they are, e.g. a symbol or trace keyword */
+static void print_string(const char *s, size_t n) {
+  if (output_length + n > sizeof(output_buffer)) flush_output();
+  if (n > sizeof(output_buffer)) {
+    fwrite(s, 1, n, stdout);
+  } else {
+    memcpy(output_buffer + output_length, s, n);
+    output_length += n;
+  }
+}
+
+/* Buffer two spaces per level of trace depth */
+static void print_indent(void) {
+  for (int i = 0; i < trace_depth; i++) {
+    print_string("  ", 2);
+  }
 }
 
 static int get_char(void) {
@@ -327,7 +367,8 @@ static int get_char(void) {
   static char *line = NULL;
   static char *ptr = NULL;
 
-  /* Get line if needed */
+  /* Get line if needed, after showing output so far */
+  if (!line) flush_output();
   if (line || (line = ptr = bestlineWithHistory("* ", "sectorlisp_gdb"))) {
     if (*ptr) {
       c = *ptr++ & 255;
@@ -400,10 +441,8 @@ static void print_object(lisp_object_t *obj);
 
 static void print_atom(lisp_object_t *obj) {
   if (obj->type != TYPE_ATOM) return;
-  /* Print character by character to match fputwc behavior */
-  for (char *s = obj->data.symbol; *s; s++) {
-    print_char(*s);
-  }
+  /* Symbol bytes are printed as they were read */
+  print_string(obj->data.symbol, strlen(obj->data.symbol));
 }
 
 static void print_list(lisp_object_t *obj) {
@@ -428,9 +467,7 @@ static void print_list(lisp_object_t *obj) {
 
 static void print_object(lisp_object_t *obj) {
   if (obj->type == TYPE_NIL) {
-    print_char('N');
-    print_char('I');
-    print_char('L');
+    print_string("NIL", 3);
   } else if (obj->type == TYPE_ATOM) {
     print_atom(obj);
   } else {
@@ -492,14 +529,10 @@ static lisp_object_t *apply(lisp_object_t *fn, lisp_object_t *args, lisp_object_
 
   /* Trace entry */
   if (trace) {
-    for (int i = 0; i < trace_depth; i++) {
-      print_char(' ');
-      print_char(' ');
-    }
-    print_char('A'); print_char('P'); print_char('P'); print_char('L'); print_char('Y');
-    print_char(':'); print_char(' ');
+    print_indent();
+    print_string("APPLY: ", 7);
     print_object(fn);
-    print_char(' '); print_char('T'); print_char('O'); print_char(' ');
+    print_string(" TO ", 4);
     print_object(args);
     print_char('\n');
   }
@@ -575,11 +608,8 @@ trace_exit:
   /* Trace exit */
   trace_depth--;
   if (trace) {
-    for (int i = 0; i < trace_depth; i++) {
-      print_char(' ');
-      print_char(' ');
-    }
-    print_char('='); print_char('>'); print_char(' ');
+    print_indent();
+    print_string("=> ", 3);
     print_object(result);
     print_char('\n');
   }
@@ -592,12 +622,8 @@ static lisp_object_t *eval(lisp_object_t *expr, lisp_object_t *env) {
 
   /* Trace entry */
   if (trace) {
-    for (int i = 0; i < trace_depth; i++) {
-      print_char(' ');
-      print_char(' ');
-    }
-    print_char('E'); print_char('V'); print_char('A'); print_char('L');
-    print_char(':'); print_char(' ');
+    print_indent();
+    print_string("EVAL: ", 6);
     print_object(expr);
     print_char('\n');
   }
@@ -639,11 +665,8 @@ trace_exit:
   /* Trace exit */
   trace_depth--;
   if (trace) {
-    for (int i = 0; i < trace_depth; i++) {
-      print_char(' ');
-      print_char(' ');
-    }
-    print_char('='); print_char('>'); print_char(' ');
+    print_indent();
+    print_string("=> ", 3);
     print_object(result);
     print_char('\n');
   }
@@ -698,6 +721,8 @@ static void init_builtins(void) {
 int main(void) {
   setlocale(LC_ALL, "");
   bestlineSetXlatCallback(bestlineUppercase);
+  output_is_tty = isatty(STDOUT_FILENO);
+  atexit(flush_output);
 
   /* Initialize builtin symbols */
   init_builtins();
@@ -708,7 +733,6 @@ int main(void) {
     lisp_object_t *result = eval(expr, nil_obj);
     print_object(result);
     print_char('\n');
-    fflush(stdout);
 
     /* GC disabled for now - heap is large enough */
     /* if (heap_ptr > HEAP_SIZE * 0.8) {
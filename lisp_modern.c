@@ -19,17 +19,20 @@
 
 // Modernized version of sectorlisp - same behavior, conventional C style
 
+#define _POSIX_C_SOURCE 200809L
 #include "bestline.h"
 
 #include <ctype.h>
+#include <setjmp.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <wchar.h>
 #include <locale.h>
 #include <limits.h>
+#include <sys/resource.h>
+#include <unistd.h>
 
 /*───────────────────────────────────────────────────────────────────────────│─╗
 │ Type Definitions and Constants                                           ─╬─│┼
@@ -53,12 +56,24 @@ typedef int32_t lisp_object_t;
 #define SYMBOL_CONS    41
 #define SYMBOL_EQ      46
 
+// Error atoms returned when a form exceeds its quota
+#define SYMBOL_CELL_LIMIT   49
+#define SYMBOL_SYMBOL_LIMIT 60
+#define SYMBOL_STACK_LIMIT  73
+
 // Predefined symbols that get initialized into the symbol table
-#define BUILTIN_SYMBOLS "NIL\0T\0QUOTE\0COND\0READ\0PRINT\0ATOM\0CAR\0CDR\0CONS\0EQ"
+#define BUILTIN_SYMBOLS "NIL\0T\0QUOTE\0COND\0READ\0PRINT\0ATOM\0CAR\0CDR\0CONS\0EQ" \
+                        "\0CELL-LIMIT\0SYMBOL-LIMIT\0STACK-LIMIT"
 
 // Memory size: 32768 elements (0100000 octal in original)
 #define MEMORY_SIZE 32768
 
+// Longest token; the token buffer occupies memory[0..TOKEN_MAX]
+#define TOKEN_MAX 1024
+
+// Most cons cells the heap holds before it runs into the token buffer
+#define CELL_CAPACITY ((MEMORY_SIZE / 2 - TOKEN_MAX - 1) / 2)
+
 // Check if a LISP object is a cons cell vs an atom
 #define IS_CONS(obj) ((obj) < 0)
 #define IS_ATOM(obj) ((obj) >= 0)
@@ -85,6 +100,39 @@ static int lookahead_char;
 static char *input_line = NULL;
 static char *input_pos = NULL;
 
+// Output not yet written to stdout, which is flushed at each newline
+// when it's a terminal and otherwise only when the buffer fills
+static char output_buffer[65536];
+static size_t output_length;
+static bool output_is_tty;
+
+// Resource usage of a single top-level form
+typedef struct {
+  long cells;         // cons cells live at once
+  long symbol_bytes;  // bytes added to the symbol table
+  long stack_bytes;   // bytes of C stack below the REPL
+} usage_t;
+
+// Per-form limits, and the high water marks of the current form
+static usage_t quota;
+static usage_t peak;
+
+// Whether to print peak usage to stderr after every form
+static bool report_usage;
+
+// Index of the empty string that ends the symbol table, now and when
+// the current form started
+static int symbol_end;
+static int form_symbol_end;
+
+// Unwinding from a form that went over quota
+static jmp_buf repl_jmp;
+static lisp_object_t quota_error;
+static char *stack_base;
+
+// Lists the reader has opened but not yet closed
+static int open_lists;
+
 /*───────────────────────────────────────────────────────────────────────────│─╗
 │ Function Prototypes                                                       ─╬─│┼
 ╚────────────────────────────────────────────────────────────────────────────│*/
@@ -92,6 +140,7 @@ static char *input_pos = NULL;
 // Input/Output
 static int get_char(void);
 static void print_char(int ch);
+static void flush_output(void);
 static int get_token(void);
 
 // Parsing
@@ -108,6 +157,10 @@ static void print_object(lisp_object_t obj);
 static void print_expression(lisp_object_t obj);
 static void print_newline(void);
 
+// Quotas
+static void quota_exceeded(lisp_object_t error);
+static void check_stack(void);
+
 // LISP Primitives
 static lisp_object_t car(lisp_object_t obj);
 static lisp_object_t cdr(lisp_object_t obj);
@@ -139,6 +192,7 @@ static int get_char(void) {
       input_pos = NULL;
     }
 
+    flush_output();
     input_line = bestlineWithHistory("* ", "sectorlisp");
     if (input_line == NULL) {
       print_char('\n');
@@ -160,9 +214,31 @@ static int get_char(void) {
   return temp;
 }
 
-// Output a single character
+// Output a single character encoded as UTF-8, which only the dot of
+// dotted pairs needs more than one byte for
 static void print_char(int ch) {
-  fputwc(ch, stdout);
+  if (output_length + 3 > sizeof(output_buffer)) {
+    flush_output();
+  }
+  if (ch < 0x80) {
+    output_buffer[output_length++] = ch;
+  } else if (ch < 0x800) {
+    output_buffer[output_length++] = 0xc0 | ch >> 6;
+    output_buffer[output_length++] = 0x80 | (ch & 0x3f);
+  } else {
+    output_buffer[output_length++] = 0xe0 | ch >> 12;
+    output_buffer[output_length++] = 0x80 | (ch >> 6 & 0x3f);
+    output_buffer[output_length++] = 0x80 | (ch & 0x3f);
+  }
+}
+
+// Write buffered output to stdout
+static void flush_output(void) {
+  fwrite(output_buffer, 1, output_length, stdout);
+  output_length = 0;
+  if (output_is_tty) {
+    fflush(stdout);
+  }
 }
 
 // Get next token from input stream
@@ -176,6 +252,12 @@ static int get_token(void) {
   do {
     ch = get_char();
     if (ch > ' ') {
+      if (i == TOKEN_MAX) {
+        while (lookahead_char > ')') {
+          get_char(); // so the rest isn't read as the next form
+        }
+        quota_exceeded(SYMBOL_SYMBOL_LIMIT);
+      }
       memory[i++] = ch;
     }
   } while (ch <= ' ' || (ch > ')' && lookahead_char > ')'));
@@ -208,12 +290,23 @@ static lisp_object_t intern_symbol(void) {
     }
   }
 
-  // Symbol not found, add it to the table
-  j = 0;
+  // Symbol not found, add it to the table if the form's quota allows
   x = --i; // Start position for new symbol
+  for (j = 0; memory[j] != 0; ++j) {
+  }
+  if (x + j + 2 > MEMORY_SIZE / 2 ||
+      (long)(x + j + 1 - form_symbol_end) * (long)sizeof(int32_t) >
+          quota.symbol_bytes) {
+    quota_exceeded(SYMBOL_SYMBOL_LIMIT);
+  }
+  j = 0;
   while ((symbol_table[i++] = memory[j++]) != 0) {
     // Copy symbol into table
   }
+  symbol_end = i;
+  if ((i - form_symbol_end) * (long)sizeof(int32_t) > peak.symbol_bytes) {
+    peak.symbol_bytes = (i - form_symbol_end) * sizeof(int32_t);
+  }
   return x;
 }
 
@@ -228,8 +321,10 @@ static lisp_object_t add_list(lisp_object_t obj) {
 
 // Parse a list (sequence of objects terminated by ')')
 static lisp_object_t get_list(void) {
+  check_stack();
   int ch = get_token();
   if (ch == ')') {
+    --open_lists;
     return 0; // NIL - empty list
   }
   return add_list(get_object(ch));
@@ -239,6 +334,7 @@ static lisp_object_t get_list(void) {
 // ch is the first character/delimiter of the object
 static lisp_object_t get_object(int ch) {
   if (ch == '(') {
+    ++open_lists;
     return get_list();
   }
   return intern_symbol();
@@ -253,13 +349,17 @@ static lisp_object_t read_expression(void) {
 │ Printer                                                                   ─╬─│┼
 ╚────────────────────────────────────────────────────────────────────────────│*/
 
-// Print an atom (symbol) by looking up its string in the symbol table
+// Print an atom (symbol) by copying its bytes from the symbol table
+// straight into the output buffer, as they were read
 static void print_atom(lisp_object_t obj) {
   int ch;
   for (;;) {
     ch = symbol_table[obj++];
     if (ch == 0) break;
-    print_char(ch);
+    if (output_length == sizeof(output_buffer)) {
+      flush_output();
+    }
+    output_buffer[output_length++] = ch;
   }
 }
 
@@ -301,6 +401,9 @@ static void print_expression(lisp_object_t obj) {
 // Print a newline
 static void print_newline(void) {
   print_char('\n');
+  if (output_is_tty) {
+    flush_output();
+  }
 }
 
 /*───────────────────────────────────────────────────────────────────────────│─╗
@@ -320,6 +423,13 @@ static lisp_object_t cdr(lisp_object_t obj) {
 // Construct a new cons cell with given car and cdr
 // Allocates from the heap (growing downward from middle of memory)
 static lisp_object_t cons(lisp_object_t car_val, lisp_object_t cdr_val) {
+  long cells = -heap_ptr / 2 + 1;
+  if (cells > quota.cells) {
+    quota_exceeded(SYMBOL_CELL_LIMIT);
+  }
+  if (cells > peak.cells) {
+    peak.cells = cells;
+  }
   symbol_table[--heap_ptr] = cdr_val;
   symbol_table[--heap_ptr] = car_val;
   return heap_ptr;
@@ -332,6 +442,7 @@ static lisp_object_t cons(lisp_object_t car_val, lisp_object_t cdr_val) {
 // Copy cons cells recursively, adjusting pointers
 // Used for compacting the heap after evaluation
 static lisp_object_t gc(lisp_object_t obj, int mark, int offset) {
+  check_stack();
   if (obj < mark) {
     return cons(gc(car(obj), mark, offset),
                 gc(cdr(obj), mark, offset)) + offset;
@@ -444,6 +555,8 @@ static lisp_object_t apply(lisp_object_t fn, lisp_object_t args,
 static lisp_object_t eval(lisp_object_t expr, lisp_object_t env) {
   int saved_heap_ptr, new_heap_ptr, final_heap_ptr;
 
+  check_stack();
+
   // Atoms are variables - look them up in environment
   if (IS_ATOM(expr)) {
     return assoc(expr, env);
@@ -479,16 +592,111 @@ static lisp_object_t eval(lisp_object_t expr, lisp_object_t env) {
   return expr;
 }
 
+/*───────────────────────────────────────────────────────────────────────────│─╗
+│ Quotas                                                                    ─╬─│┼
+╚────────────────────────────────────────────────────────────────────────────│*/
+
+// Abandon the current form, making the REPL print the given error atom
+static void quota_exceeded(lisp_object_t error) {
+  quota_error = error;
+  longjmp(repl_jmp, 1);
+}
+
+// Track C stack use of the recursive reader, evaluator and collector
+static void check_stack(void) {
+  char here;
+  long used = stack_base - &here;
+  if (used > quota.stack_bytes) {
+    quota_exceeded(SYMBOL_STACK_LIMIT);
+  }
+  if (used > peak.stack_bytes) {
+    peak.stack_bytes = used;
+  }
+}
+
+// Default limits are whatever memory and the stack rlimit can hold
+static void init_quotas(void) {
+  struct rlimit rl;
+  quota.cells = CELL_CAPACITY;
+  quota.symbol_bytes = MEMORY_SIZE / 2 * sizeof(int32_t);
+  quota.stack_bytes = 8 * 1024 * 1024;
+  if (getrlimit(RLIMIT_STACK, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY) {
+    quota.stack_bytes = rl.rlim_cur;
+  }
+  quota.stack_bytes = quota.stack_bytes / 4 * 3;
+}
+
+// Undo what a failed form did to the symbol table and input
+static void abort_form(void) {
+  int ch;
+  memset(symbol_table + form_symbol_end, 0,
+         (symbol_end - form_symbol_end + 1) * sizeof(int32_t));
+  symbol_end = form_symbol_end;
+  // Skip the rest of a half read form, and nothing after it
+  while (open_lists > 0) {
+    ch = get_char();
+    if (ch == '(') {
+      ++open_lists;
+    } else if (ch == ')') {
+      --open_lists;
+    }
+  }
+}
+
+static void report_form_usage(void) {
+  fprintf(stderr, "; cells %ld/%ld symbol bytes %ld/%ld stack bytes %ld/%ld\n",
+          peak.cells, quota.cells, peak.symbol_bytes, quota.symbol_bytes,
+          peak.stack_bytes, quota.stack_bytes);
+}
+
+static bool parse_limit(const char *arg, const char *name, long *limit) {
+  size_t n = strlen(name);
+  char *end;
+  if (strncmp(arg, name, n) != 0 || arg[n] != '=') {
+    return false;
+  }
+  *limit = strtol(arg + n + 1, &end, 10);
+  if (*end != '\0' || *limit <= 0) {
+    fprintf(stderr, "bad limit: %s\n", arg);
+    exit(1);
+  }
+  return true;
+}
+
 /*───────────────────────────────────────────────────────────────────────────│─╗
 │ Main Program                                                              ─╬─│┼
 ╚────────────────────────────────────────────────────────────────────────────│*/
 
-int main(void) {
+int main(int argc, char *argv[]) {
+  char base;
   size_t i;
+  lisp_object_t result;
+
+  // Per-form quotas: --max-cells=N --max-symbol-bytes=N --max-stack-bytes=N
+  init_quotas();
+  for (i = 1; i < (size_t)argc; ++i) {
+    if (strcmp(argv[i], "--report") == 0) {
+      report_usage = true;
+    } else if (!parse_limit(argv[i], "--max-cells", &quota.cells) &&
+               !parse_limit(argv[i], "--max-symbol-bytes", &quota.symbol_bytes) &&
+               !parse_limit(argv[i], "--max-stack-bytes", &quota.stack_bytes)) {
+      fprintf(stderr, "usage: %s [--max-cells=N] [--max-symbol-bytes=N] "
+              "[--max-stack-bytes=N] [--report]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (quota.cells > CELL_CAPACITY) {
+    quota.cells = CELL_CAPACITY; // more can't fit, whatever was asked for
+  }
+  stack_base = &base;
 
   // Initialize locale for Unicode support
   setlocale(LC_ALL, "");
 
+  // Buffer output, writing whatever is left when exiting
+  output_is_tty = isatty(STDOUT_FILENO);
+  atexit(flush_output);
+
   // Configure bestline (readline library)
   bestlineSetXlatCallback(bestlineUppercase);
 
@@ -496,12 +704,24 @@ int main(void) {
   for (i = 0; i < sizeof(BUILTIN_SYMBOLS); ++i) {
     symbol_table[i] = BUILTIN_SYMBOLS[i];
   }
+  symbol_end = sizeof(BUILTIN_SYMBOLS);
 
   // REPL: Read-Eval-Print Loop
   for (;;) {
     heap_ptr = 0;
-    print_expression(eval(read_expression(), 0));
+    form_symbol_end = symbol_end;
+    memset(&peak, 0, sizeof(peak));
+    if (setjmp(repl_jmp) == 0) {
+      result = eval(read_expression(), 0);
+    } else {
+      abort_form();
+      result = quota_error;
+    }
+    print_expression(result);
     print_newline();
+    if (report_usage) {
+      report_form_usage();
+    }
   }
 
   return 0;
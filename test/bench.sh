@@ -0,0 +1,306 @@
+#!/bin/sh
+# Benchmarks for lisp.c. Runs every suite, or just the ones named:
+#   layout  interleaved vs struct-of-arrays cells on car and cdr walks
+#   intern  reading 10k to 1M distinct symbols
+#   batch   piped and -f input of a 100k line program
+#   mmap    a 100 MB dataset from a mapped file vs a pipe
+#   scan    scalar, SSE2 and AVX2 token scanning of mapped input
+#   binary  text vs binary s-expression size and load time
+#   reader  a 1M element flat list and 1M deep nesting
+#   stream  --map over a 1M record list at the default heap size
+#   pipe    reading on the main thread vs a -p reader thread
+#   threads files of list walks on 1 to 8 worker threads
+#   files   20k small files loaded with io_uring vs plain reads
+#   print   printing 1M atoms of dotted lists
+#   writer  a burst of output to a slow pipe, then work, with and without -w
+#   serve   requests over 4 connections to --serve on 1 and 4 threads,
+#           and 4 forked processes replaced every 100 requests
+set -e
+CC=${CC:-cc}
+CFLAGS="-std=gnu89 -w -O2"
+TMP=${TMPDIR:-/tmp}/sectorlisp-bench.$$
+trap 'rm -rf "$TMP"' EXIT
+mkdir -p "$TMP"
+HOME=$TMP # keep line history out of the real one
+export HOME
+SUITES=${*:-layout intern batch mmap scan binary reader stream pipe threads files print writer serve}
+[ -x tbench ] || $CC -o tbench tbench.c -Wall
+TBENCH=$PWD/tbench
+[ -x tload ] || $CC -o tload tload.c -Wall -pthread
+TLOAD=$PWD/tload
+
+layout() {
+  local DEPTH=${DEPTH:-4000}
+  local REPS=${REPS:-20}
+  $CC $CFLAGS -DRAMSIZE=0x100000 -o "$TMP/lisp-aos" ../lisp.c ../bestline.c -lpthread
+  $CC $CFLAGS -DRAMSIZE=0x100000 -DSOA -o "$TMP/lisp-soa" ../lisp.c ../bestline.c -lpthread
+
+  # (FF '((((...A...))))) repeated REPS times
+  awk -v d=$DEPTH -v r=$REPS 'BEGIN {
+    t = "A"; for (i = 0; i < d; i++) t = "(" t ")"
+    l = ""; for (i = 0; i < r; i++) l = l " X"
+    print "((LAMBDA (FF REP) (REP (QUOTE (" l "))))"
+    print " (QUOTE (LAMBDA (X) (COND ((ATOM X) X) ((QUOTE T) (FF (CAR X))))))"
+    print " (QUOTE (LAMBDA (L) (COND ((EQ L NIL) NIL)"
+    print "  ((QUOTE T) ((LAMBDA (Y) (REP (CDR L))) (FF (QUOTE " t "))))))))"
+  }' >"$TMP/ff.lisp"
+
+  # (LENGTH '(X X X ...)) repeated REPS times
+  awk -v d=$DEPTH -v r=$REPS 'BEGIN {
+    t = ""; for (i = 0; i < d; i++) t = t " X"
+    l = ""; for (i = 0; i < r; i++) l = l " X"
+    print "((LAMBDA (LENGTH REP) (REP (QUOTE (" l "))))"
+    print " (QUOTE (LAMBDA (X) (COND ((EQ X NIL) NIL) ((QUOTE T) (LENGTH (CDR X))))))"
+    print " (QUOTE (LAMBDA (L) (COND ((EQ L NIL) NIL)"
+    print "  ((QUOTE T) ((LAMBDA (Y) (REP (CDR L))) (LENGTH (QUOTE (" t ")))))))))"
+  }' >"$TMP/length.lisp"
+
+  for w in ff length; do
+    for l in aos soa; do
+      (cd "$TMP" && "$TBENCH" $w.lisp ./lisp-$l)
+    done
+  done
+}
+
+intern() {
+  $CC $CFLAGS -DRAMSIZE=0x1000000 -o "$TMP/lisp" ../lisp.c ../bestline.c -lpthread
+  # ((LAMBDA (X) NIL) '((S1 ... S1000) (S1001 ... S2000) ...)) on one line
+  for n in 10000 100000 1000000; do
+    awk -v n=$n 'BEGIN {
+      printf "((LAMBDA (X) NIL) (QUOTE ("
+      for (i = 0; i < n; i++) {
+        if (i % 1000 == 0) printf "%s(", i ? ") " : ""
+        printf "S%d ", i
+      }
+      print "))))"
+    }' >"$TMP/intern$n.lisp"
+    (cd "$TMP" && "$TBENCH" -n 1 intern$n.lisp ./lisp)
+  done
+}
+
+batch() {
+  local LINES=${LINES:-100000}
+  $CC $CFLAGS -o "$TMP/lisp" ../lisp.c ../bestline.c -lpthread
+  awk -v n=$LINES 'BEGIN {
+    for (i = 0; i < n; i++) print "(CONS (QUOTE A" i % 50 ") (QUOTE B))"
+  }' >"$TMP/batch.lisp"
+  (cd "$TMP" && "$TBENCH" batch.lisp ./lisp)
+  (cd "$TMP" && "$TBENCH" batch.lisp ./lisp -f batch.lisp)
+}
+
+mmap() {
+  local MB=${MB:-100}
+  $CC $CFLAGS -DRAMSIZE=0x1000000 -o "$TMP/lisp" ../lisp.c ../bestline.c -lpthread
+  # ((LAMBDA (X) NIL) '(R1C0 R1C1 ... R1C15)) per line, MB megabytes
+  awk -v n=$((MB * 1000000 / 130)) 'BEGIN {
+    for (i = 0; i < n; i++) {
+      printf "((LAMBDA (X) NIL) (QUOTE ("
+      for (j = 0; j < 16; j++) printf " R%dC%d", i % 1000, j
+      print ")))"
+    }
+  }' >"$TMP/data.lisp"
+  (cd "$TMP" && "$TBENCH" -n 1 data.lisp ./lisp -f data.lisp)
+  (cd "$TMP" && "$TBENCH" -n 1 data.lisp sh -c "cat | ./lisp")
+}
+
+scan() {
+  local MB=${MB:-20}
+  $CC $CFLAGS -DRAMSIZE=0x1000000 -U__SSE2__ -o "$TMP/lisp-scalar" ../lisp.c ../bestline.c -lpthread
+  $CC $CFLAGS -DRAMSIZE=0x1000000 -o "$TMP/lisp-sse2" ../lisp.c ../bestline.c -lpthread
+  $CC $CFLAGS -DRAMSIZE=0x1000000 -mavx2 -o "$TMP/lisp-avx2" ../lisp.c ../bestline.c -lpthread
+  # ((LAMBDA (X) NIL) '(SYMBOL-0-WITH-A-RATHER-LONG-NAME ...)) per line
+  awk -v n=$((MB * 1000000 / 400)) 'BEGIN {
+    for (i = 0; i < n; i++) {
+      printf "((LAMBDA (X) NIL) (QUOTE ("
+      for (j = 0; j < 8; j++) printf "    SYMBOL-%d-WITH-A-RATHER-LONG-NAME", j
+      print ")))"
+    }
+  }' >"$TMP/scan.lisp"
+  for l in scalar sse2 avx2; do
+    grep -q avx2 /proc/cpuinfo 2>/dev/null || [ $l != avx2 ] || continue
+    (cd "$TMP" && "$TBENCH" scan.lisp ./lisp-$l -f scan.lisp)
+  done
+}
+
+binary() {
+  local MB=${MB:-20}
+  $CC $CFLAGS -DRAMSIZE=0x1000000 -o "$TMP/lisp" ../lisp.c ../bestline.c -lpthread
+  # ((LAMBDA (X) NIL) '((K0 . V0) (K1 . V1) ...)) per line
+  awk -v n=$((MB * 1000000 / 250)) 'BEGIN {
+    for (i = 0; i < n; i++) {
+      printf "((LAMBDA (X) NIL) (QUOTE ("
+      for (j = 0; j < 16; j++) printf " (KEY%d . VALUE%d)", j, (i + j) % 1000
+      print ")))"
+    }
+  }' >"$TMP/data.lisp"
+  (cd "$TMP" && ./lisp --encode data.lisp data.sxb && ls -l data.lisp data.sxb)
+  (cd "$TMP" && "$TBENCH" data.lisp ./lisp -f data.lisp)
+  (cd "$TMP" && "$TBENCH" data.lisp ./lisp -f data.sxb)
+}
+
+reader() {
+  $CC $CFLAGS -DRAMSIZE=0x1000000 -o "$TMP/lisp" ../lisp.c ../bestline.c -lpthread
+  # ((LAMBDA (X) NIL) '(X X X ...)) and ((LAMBDA (X) NIL) '((((...)))))
+  awk 'BEGIN {
+    printf "((LAMBDA (X) NIL) (QUOTE ("
+    for (i = 0; i < 1000000; i++) printf " X"
+    print ")))"
+  }' >"$TMP/flat.lisp"
+  awk 'BEGIN {
+    printf "((LAMBDA (X) NIL) (QUOTE "
+    for (i = 0; i < 1000000; i++) printf "("
+    for (i = 0; i < 1000000; i++) printf ")"
+    print "))"
+  }' >"$TMP/deep.lisp"
+  (cd "$TMP" && "$TBENCH" flat.lisp ./lisp)
+  (cd "$TMP" && "$TBENCH" deep.lisp ./lisp)
+}
+
+stream() {
+  $CC $CFLAGS -o "$TMP/lisp" ../lisp.c ../bestline.c -lpthread
+  # ((R0 (K V0) X) (R1 (K V1) X) ...) is too big to read as one list
+  awk 'BEGIN {
+    printf "("
+    for (i = 0; i < 1000000; i++) printf " (R%d (K V%d) X)", i % 5000, i
+    print ")"
+  }' >"$TMP/records.lisp"
+  (cd "$TMP" && "$TBENCH" records.lisp ./lisp --map "(LAMBDA (R) (CAR (CDR R)))" -f records.lisp)
+}
+
+pipe() {
+  $CC $CFLAGS -DRAMSIZE=0x1000000 -o "$TMP/lisp" ../lisp.c ../bestline.c -lpthread
+  # 20k of ((LAMBDA (X) NIL) (QUOTE (S0 S1 ... S199))), all reading
+  awk 'BEGIN {
+    for (i = 0; i < 20000; i++) {
+      printf "((LAMBDA (X) NIL) (QUOTE ("
+      for (j = 0; j < 200; j++) printf " S%d", (i + j) % 5000
+      print ")))"
+    }
+  }' >"$TMP/parse.lisp"
+  # 5k of the same lists walked to their last element, mostly evaluating
+  awk 'BEGIN {
+    for (i = 0; i < 5000; i++) {
+      printf "((LAMBDA (LAST) (LAST (QUOTE ("
+      for (j = 0; j < 200; j++) printf " S%d", (i + j) % 5000
+      print "))))"
+      print " (QUOTE (LAMBDA (L) (COND ((EQ (CDR L) NIL) (CAR L))"
+      print "  ((QUOTE T) (LAST (CDR L)))))))"
+    }
+  }' >"$TMP/walk.lisp"
+  for f in parse walk; do
+    echo "$f.lisp mapped, then piped, each without and with -p"
+    (cd "$TMP" && "$TBENCH" $f.lisp ./lisp)
+    (cd "$TMP" && "$TBENCH" $f.lisp ./lisp -p)
+    (cd "$TMP" && "$TBENCH" $f.lisp sh -c "cat $f.lisp | ./lisp")
+    (cd "$TMP" && "$TBENCH" $f.lisp sh -c "cat $f.lisp | ./lisp -p")
+  done
+}
+
+threads() {
+  local FILES=${FILES:-32} WALKS=${WALKS:-200}
+  $CC $CFLAGS -DRAMSIZE=0x100000 -o "$TMP/lisp" ../lisp.c ../bestline.c -lpthread
+  # each file walks a 300 element list WALKS times, so evaluation
+  # rather than startup is what's spread over the threads
+  awk -v n=$WALKS 'BEGIN {
+    for (i = 0; i < n; i++) {
+      printf "((LAMBDA (LAST) (LAST (QUOTE ("
+      for (j = 0; j < 300; j++) printf " S%d", j
+      print ")))) (QUOTE (LAMBDA (L) (COND ((EQ (CDR L) NIL) (CAR L))"
+      print "  ((QUOTE T) (LAST (CDR L)))))))"
+    }
+  }' >"$TMP/walks.lisp"
+  files=
+  for i in $(seq $FILES); do
+    cp "$TMP/walks.lisp" "$TMP/walks$i.lisp"
+    files="$files walks$i.lisp"
+  done
+  # throughput is over all the files, so input is their concatenation
+  (cd "$TMP" && cat $files >all.lisp)
+  for j in 1 2 4 8; do
+    echo "$FILES files of $WALKS list walks on $j threads"
+    (cd "$TMP" && "$TBENCH" all.lisp ./lisp -j $j $files)
+  done
+}
+
+files() {
+  local FILES=${FILES:-20000}
+  $CC $CFLAGS -o "$TMP/lisp" ../lisp.c ../bestline.c -lpthread
+  $CC $CFLAGS -DNOURING -o "$TMP/lisp-read" ../lisp.c ../bestline.c -lpthread
+  mkdir -p "$TMP/files"
+  awk -v n=$FILES -v d="$TMP/files" 'BEGIN {
+    for (i = 0; i < n; i++) {
+      f = sprintf("%s/%05d.lisp", d, i)
+      print "((LAMBDA (X) (CONS (CAR X) (CDR X))) (QUOTE (A" i % 50 " B C)))" >f
+      close(f)
+    }
+  }'
+  for j in 1 4; do
+    for l in lisp lisp-read; do
+      echo "$FILES files on $j threads, $l"
+      (cd "$TMP/files" && ../$l -j $j --stats *.lisp >/dev/null)
+    done
+  done
+}
+
+print() {
+  $CC $CFLAGS -DRAMSIZE=0x1000000 -o "$TMP/lisp" ../lisp.c ../bestline.c -lpthread
+  # 1k of (CONS (QUOTE (KEY0 KEY1 ... KEY999)) (QUOTE VALUE)), mostly printing
+  awk 'BEGIN {
+    for (i = 0; i < 1000; i++) {
+      printf "(CONS (QUOTE ("
+      for (j = 0; j < 1000; j++) printf " KEY%d", (i + j) % 5000
+      print ")) (QUOTE VALUE))"
+    }
+  }' >"$TMP/print.lisp"
+  (cd "$TMP" && "$TBENCH" print.lisp sh -c "./lisp <print.lisp >/dev/null")
+}
+
+writer() {
+  $CC $CFLAGS -o "$TMP/lisp" ../lisp.c ../bestline.c -lpthread
+  # 100 lists of 1000 atoms, then 2000 walks of a list that print little
+  awk 'BEGIN {
+    for (i = 0; i < 100; i++) {
+      printf "(QUOTE ("
+      for (j = 0; j < 1000; j++) printf " KEY%d", (i + j) % 5000
+      print "))"
+    }
+    for (i = 0; i < 2000; i++) {
+      printf "((LAMBDA (LAST) (LAST (QUOTE ("
+      for (j = 0; j < 300; j++) printf " S%d", j
+      print ")))) (QUOTE (LAMBDA (L) (COND ((EQ (CDR L) NIL) (CAR L))"
+      print "  ((QUOTE T) (LAST (CDR L)))))))"
+    }
+  }' >"$TMP/burst.lisp"
+  # a reader of 64 KiB every 50 ms
+  echo 'while [ "$(dd bs=65536 count=1 2>/dev/null | wc -c)" -gt 0 ]; do
+  sleep 0.05
+done' >"$TMP/slow.sh"
+  for w in "" -w; do
+    (cd "$TMP" && "$TBENCH" burst.lisp sh -c "./lisp $w <burst.lisp | sh slow.sh")
+  done
+}
+
+serve() {
+  local REQUESTS=${REQUESTS:-500}
+  $CC $CFLAGS -o "$TMP/lisp" ../lisp.c ../bestline.c -lpthread
+  # a walk to the end of a 300 element list, as one line
+  form=$(awk 'BEGIN {
+    printf "((LAMBDA (LAST) (LAST (QUOTE ("
+    for (j = 0; j < 300; j++) printf " S%d", j
+    printf ")))) (QUOTE (LAMBDA (L) (COND ((EQ (CDR L) NIL) (CAR L))"
+    printf " ((QUOTE T) (LAST (CDR L)))))))"
+  }')
+  for j in "-j 1" "-j 4" "--prefork 4 --requests 100"; do
+    echo "4 connections to lisp $j"
+    "$TMP/lisp" $j --serve "$TMP/sock" &
+    pid=$!
+    while [ ! -S "$TMP/sock" ]; do sleep 0.1; done
+    "$TLOAD" -c 4 -n $REQUESTS "$TMP/sock" "$form"
+    kill $pid
+    rm -f "$TMP/sock"
+  done
+}
+
+for s in $SUITES; do
+  $s
+done
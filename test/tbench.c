@@ -0,0 +1,127 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+/*
+ * usage: tbench [-n RUNS] INPUT COMMAND [ARGS...]
+ *
+ * Runs COMMAND with INPUT on stdin and stdout discarded, and reports the
+ * best wall time of RUNS, INPUT throughput in MB/s and bytes per cycle,
+ * and last level cache misses.
+ */
+
+static int counter(pid_t pid, int config)
+{
+#ifdef __linux__
+	struct perf_event_attr a;
+	memset(&a, 0, sizeof(a));
+	a.size = sizeof(a);
+	a.type = PERF_TYPE_HARDWARE;
+	a.config = config;
+	a.disabled = 1;
+	a.inherit = 1;
+	a.enable_on_exec = 1;
+	a.exclude_kernel = 1;
+	return syscall(__NR_perf_event_open, &a, pid, -1, -1, 0);
+#else
+	return -1;
+#endif
+}
+
+static long long total(int fd)
+{
+	long long n;
+	if (fd == -1)
+		return -1;
+	if (read(fd, &n, sizeof(n)) != sizeof(n))
+		n = -1;
+	close(fd);
+	return n;
+}
+
+static double run(const char *input, char **argv, long long *misses,
+		  long long *cycles)
+{
+	int p[2], fd, fc, ws;
+	struct timeval t0, t1;
+	pid_t pid;
+	char c;
+	if (pipe(p) == -1) {
+		perror("pipe");
+		exit(1);
+	}
+	if (!(pid = fork())) {
+		close(p[1]);
+		if ((fd = open(input, O_RDONLY)) == -1) {
+			perror(input);
+			_exit(127);
+		}
+		dup2(fd, 0);
+		dup2(open("/dev/null", O_WRONLY), 1);
+		read(p[0], &c, 1);
+		execvp(argv[0], argv);
+		perror(argv[0]);
+		_exit(127);
+	}
+	close(p[0]);
+	fd = counter(pid, PERF_COUNT_HW_CACHE_MISSES);
+	fc = counter(pid, PERF_COUNT_HW_CPU_CYCLES);
+	gettimeofday(&t0, 0);
+	close(p[1]);
+	waitpid(pid, &ws, 0);
+	gettimeofday(&t1, 0);
+	if (!WIFEXITED(ws) || WEXITSTATUS(ws)) {
+		fprintf(stderr, "%s: failed on %s\n", argv[0], input);
+		exit(1);
+	}
+	*misses = total(fd);
+	*cycles = total(fc);
+	return (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec) * 1e-6;
+}
+
+int main(int argc, char *argv[])
+{
+	int i, n = 3;
+	double t, best = 1e99;
+	long long m, c, misses = -1, cycles = -1;
+	struct stat st;
+	char buf[32], bpc[32];
+	if (argc > 2 && !strcmp(argv[1], "-n")) {
+		n = atoi(argv[2]);
+		argv += 2;
+		argc -= 2;
+	}
+	if (argc < 3 || stat(argv[1], &st) == -1) {
+		fprintf(stderr, "usage: %s [-n RUNS] INPUT COMMAND [ARGS...]\n",
+			argv[0]);
+		return 1;
+	}
+	for (i = 0; i < n; i++) {
+		if ((t = run(argv[1], argv + 2, &m, &c)) < best) {
+			best = t;
+			misses = m;
+			cycles = c;
+		}
+	}
+	if (misses < 0)
+		strcpy(buf, "n/a");
+	else
+		snprintf(buf, sizeof(buf), "%lld", misses);
+	if (cycles <= 0)
+		strcpy(bpc, "n/a");
+	else
+		snprintf(bpc, sizeof(bpc), "%.3f", (double)st.st_size / cycles);
+	printf("%-28s %-16s %9.3f s %9.2f MB/s %7s B/cycle %14s misses\n",
+	       argv[1], argv[2], best, st.st_size / best / 1e6, bpc, buf);
+	return 0;
+}
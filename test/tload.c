@@ -0,0 +1,142 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * usage: tload [-c CONNECTIONS] [-n REQUESTS] SOCKET FORM
+ *
+ * Opens CONNECTIONS to a lisp --serve SOCKET, and on each sends FORM
+ * and waits for its response REQUESTS times. Reports requests per second
+ * and percentiles of round trip latency and of the evaluation time the
+ * server reports.
+ */
+
+struct conn {
+	pthread_t th;
+	int fd;
+	double *rtt, *eval;
+};
+
+static const char *form;
+static int requests;
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int dial(const char *path)
+{
+	int fd;
+	struct sockaddr_un a;
+	memset(&a, 0, sizeof(a));
+	a.sun_family = AF_UNIX;
+	strncpy(a.sun_path, path, sizeof(a.sun_path) - 1);
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1 ||
+	    connect(fd, (struct sockaddr *)&a, sizeof(a)) == -1) {
+		perror(path);
+		exit(1);
+	}
+	return fd;
+}
+
+static void *client(void *arg)
+{
+	struct conn *c = arg;
+	char buf[65536], *tab;
+	int i, k, n, len = strlen(form);
+	double t0;
+	for (i = 0; i < requests; i++) {
+		t0 = now();
+		if (write(c->fd, form, len) != len) {
+			perror("write");
+			exit(1);
+		}
+		/* a response is one line, which fits unless it's huge */
+		for (n = 0; !n || buf[n - 1] != '\n'; n += k) {
+			if (n == sizeof(buf))
+				n = 0;
+			if ((k = read(c->fd, buf + n, sizeof(buf) - n)) <= 0) {
+				fprintf(stderr, "server hung up\n");
+				exit(1);
+			}
+		}
+		c->rtt[i] = now() - t0;
+		buf[n - 1] = 0;
+		tab = strrchr(buf, '\t');
+		c->eval[i] = tab ? atof(tab + 1) * 1e-6 : 0;
+	}
+	close(c->fd); /* so the server thread can take another connection */
+	return 0;
+}
+
+static int compare(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static void report(const char *name, double *v, long n)
+{
+	qsort(v, n, sizeof(*v), compare);
+	printf("  %-7s p50 %9.1f us  p90 %9.1f us  p99 %9.1f us  max %9.1f us\n",
+	       name, v[n / 2] * 1e6, v[n * 9 / 10] * 1e6, v[n * 99 / 100] * 1e6,
+	       v[n - 1] * 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+	int i, opt, conns = 1;
+	long n;
+	double t0, t;
+	double *rtt, *eval;
+	struct conn *c;
+	char *f;
+	requests = 1000;
+	while ((opt = getopt(argc, argv, "c:n:")) != -1) {
+		if (opt == 'c')
+			conns = atoi(optarg);
+		else if (opt == 'n')
+			requests = atoi(optarg);
+		else
+			argc = 0;
+	}
+	if (argc - optind != 2 || conns < 1 || requests < 1) {
+		fprintf(stderr,
+			"usage: %s [-c CONNECTIONS] [-n REQUESTS] SOCKET FORM\n",
+			argv[0]);
+		return 1;
+	}
+	/* responses are framed by newlines, so requests must be too */
+	f = malloc(strlen(argv[optind + 1]) + 2);
+	strcpy(f, argv[optind + 1]);
+	strcat(f, "\n");
+	form = f;
+	n = (long)conns * requests;
+	rtt = malloc(n * sizeof(*rtt));
+	eval = malloc(n * sizeof(*eval));
+	c = calloc(conns, sizeof(*c));
+	for (i = 0; i < conns; i++) {
+		c[i].fd = dial(argv[optind]);
+		c[i].rtt = rtt + (long)i * requests;
+		c[i].eval = eval + (long)i * requests;
+	}
+	t0 = now();
+	for (i = 0; i < conns; i++)
+		pthread_create(&c[i].th, 0, client, c + i);
+	for (i = 0; i < conns; i++)
+		pthread_join(c[i].th, 0);
+	t = now() - t0;
+	printf("%ld requests on %d connections in %.3f s, %.0f requests/s\n", n,
+	       conns, t, n / t);
+	report("latency", rtt, n);
+	report("eval", eval, n);
+	return 0;
+}